@@ -0,0 +1,11 @@
+#ifndef BATCH_H
+#define BATCH_H
+int batch_chunk_points(struct Cse_Dag *dag);
+int batch_eval(struct Cse_Dag *dag, const double *const *columns, int columns_num, long points,
+               double *res, int threads);
+
+constexpr long BATCH_CACHE_BYTES = 256 * 1024;  // scratch of one chunk fits into L2 cache
+constexpr int BATCH_MIN_CHUNK_POINTS = 16;
+constexpr int BATCH_MAX_CHUNK_POINTS = 4096;
+constexpr int BATCH_CACHE_LINE = 64;
+#endif
@@ -0,0 +1,14 @@
+#ifndef BENCH_H
+#define BENCH_H
+constexpr int BENCH_MIN_NODES = 16;
+constexpr int BENCH_MAX_NODES = 4096;
+constexpr int BENCH_STEP = 4;
+constexpr int BENCH_REPS = 5;
+constexpr int BENCH_DEPTHS[] = {8, 32, 1024};
+constexpr int BENCH_DEPTHS_NUM = sizeof(BENCH_DEPTHS) / sizeof(BENCH_DEPTHS[0]);
+constexpr int BENCH_PROGRAM_DEPTH = 4;
+constexpr int BENCH_TAYLOR_ORDER = 8;
+constexpr int BENCH_EXPR_POINTS = 1 << 16;
+constexpr long BENCH_BATCH_POINTS = 1 << 22;
+constexpr int BENCH_BATCH_NODES = 256;
+#endif
@@ -0,0 +1,53 @@
+#ifndef BIN_TREE_H
+#define BIN_TREE_H
+#include <stdint.h>
+
+// File layout (all parts are 8 bytes aligned):
+// Bin_Header | double constants[consts_num] | Bin_Node nodes[nodes_num] (preorder) |
+// uint32_t name_offsets[names_num + 1] | names (each ends with '\0')
+struct Bin_Header {
+    char magic[4];
+    uint32_t version;
+    uint32_t nodes_num;
+    uint32_t consts_num;
+    uint32_t names_num;
+    uint32_t names_size;
+    uint64_t consts_offset;
+    uint64_t nodes_offset;
+    uint64_t name_offsets_offset;
+    uint64_t names_offset;
+};
+
+struct Bin_Node {
+    uint8_t operation;
+    uint8_t reserved[3];
+    uint32_t children_number;
+    uint32_t subtree_size;  // this node and all its descendants, next sibling is at index + subtree_size
+    uint32_t operand;       // constant index for CONSTANT, name index for VAR, FUNC_CALL, FUNC_DEF
+};
+
+//! \brief Loaded binary tree. Points into the mmaped file, so nothing is copied
+struct Bin_Tree {
+    char *data;
+    int size;
+    const struct Bin_Header *header;
+    const double *consts;
+    const struct Bin_Node *nodes;
+    const uint32_t *name_offsets;
+    const char *names;
+};
+
+int write_bin_tree(int fd, Node *root);
+int save_bin_tree(char *filename, Node *root);
+struct Bin_Tree *load_bin_tree(char *filename);
+void unload_bin_tree(struct Bin_Tree *tree);
+int bin_child(struct Bin_Tree *tree, int node, int child_ind);
+const char *bin_name(struct Bin_Tree *tree, int node);
+double bin_value(struct Bin_Tree *tree, int node);
+double bin_get_val(struct Bin_Tree *tree, int node);
+Node *bin_build_tree(struct Bin_Tree *tree, int node);
+
+constexpr char BIN_MAGIC[4] = {'N', 'T', 'R', 'B'};
+constexpr uint32_t BIN_VERSION = 1;
+constexpr uint32_t BIN_NO_OPERAND = UINT32_MAX;
+#endif
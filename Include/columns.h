@@ -0,0 +1,34 @@
+#ifndef COLUMNS_H
+#define COLUMNS_H
+#include <stdint.h>
+
+// File layout (all parts are 8 bytes aligned):
+// Col_Header | names (each ends with '\0') | double columns[columns_num][rows]
+struct Col_Header {
+    char magic[4];
+    uint32_t version;
+    uint32_t columns_num;
+    uint32_t names_size;
+    uint64_t rows;
+    uint64_t names_offset;
+    uint64_t data_offset;
+};
+
+//! \brief Loaded columnar file. Points into the mmaped file, so nothing is copied
+struct Col_File {
+    char *data;
+    long size;
+    const struct Col_Header *header;
+    const char **names;
+    const double **columns;
+};
+
+long columns_layout(const char *const *names, int columns_num, long rows, char *data);
+struct Col_File *load_columns(char *filename);
+void unload_columns(struct Col_File *file);
+int columns_eval(struct Cse_Dag *dag, char *in_file, char *out_file, const char *out_name, int threads);
+
+constexpr char COL_MAGIC[4] = {'N', 'T', 'R', 'C'};
+constexpr uint32_t COL_VERSION = 1;
+constexpr long COL_WINDOW_ROWS = 1 << 20;   // rows, calculated between releases of pages
+#endif
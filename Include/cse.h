@@ -0,0 +1,12 @@
+#ifndef CSE_H
+#define CSE_H
+struct Cse_Dag *cse_build(Node *root);
+void cse_free(struct Cse_Dag *dag);
+int cse_nodes_number(struct Cse_Dag *dag);
+int cse_shared_number(struct Cse_Dag *dag);
+double cse_eval(struct Cse_Dag *dag, const double *values, int values_num);
+double cse_eval_temps(struct Cse_Dag *dag, const double *values, int values_num, double *temps);
+int cse_eval_columns(struct Cse_Dag *dag, const double *const *columns, int columns_num,
+                     long first, int count, double *temps, double *res);
+int cse_export_dot(struct Cse_Dag *dag, int fd, char *graph_name = NULL);
+#endif
@@ -0,0 +1,11 @@
+#ifndef DISK_CACHE_H
+#define DISK_CACHE_H
+char *disk_cache_dir(const char *dir, const char *default_name);
+void disk_cache_evict(const char *dir, long max_bytes, int evicted_counter);
+char *disk_cache_identity(const char *path);
+char *disk_cache_entry(const char *dir, const char *const *keys, int keys_num,
+                       const char *text, long size, const char *extension);
+int disk_cache_copy(const char *from, const char *to, int mode);
+
+constexpr int DISK_CACHE_COPY_BLOCK = 1 << 16;
+#endif
@@ -0,0 +1,13 @@
+#ifndef EGRAPH_H
+#define EGRAPH_H
+enum Cost_Models {
+    COST_NODES = 0, // number of nodes in the extracted tree
+    COST_EVAL,      // estimated cost of get_val: ln, sin, cos and ^ are expensive
+};
+
+Node *egraph_simplify(Node *root, int cost_model, long max_nodes, int max_iterations);
+int parse_cost_model(const char *name);
+
+constexpr long EGRAPH_MAX_NODES = 10000;
+constexpr int EGRAPH_MAX_ITERATIONS = 12;
+#endif
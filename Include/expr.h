@@ -0,0 +1,339 @@
+#ifndef EXPR_H
+#define EXPR_H
+#include <cmath>
+
+//! \brief Expressions, fixed at build time: the type of expression is its tree,
+//! so evaluation is inlined and derivates are built by the compiler.
+//! Operations are the same as Node_Types (tree.h must be included before).
+//! Variables are named by one character and their values are indexed by it:
+//!     Var<'x'> x;
+//!     auto func = sin(x) * pow(x, 3.0) + 1.0;
+//!     double values[EXPR_VALUES_NUM] = {};
+//!     values['x'] = 0.5;
+//!     double res = expr_derivate<'x'>(func).eval(values);
+//!     Node *tree = func.to_node();   // for export and comparison
+//! Evaluation of expressions without ln, sin, cos and ^ is constexpr.
+constexpr int EXPR_VALUES_NUM = 128;
+
+//! \brief Base of all expressions, operators accept only its descendants
+template <class E>
+struct Expr {
+    constexpr const E &self() const {
+        return static_cast<const E &>(*this);
+    }
+};
+
+template <bool Cond, class True, class False>
+struct Expr_Select {
+    typedef True type;
+};
+
+template <class True, class False>
+struct Expr_Select<false, True, False> {
+    typedef False type;
+};
+
+//! \brief Constant 0, derivates are folded by it at compile time
+struct Zero : Expr<Zero> {
+    constexpr double eval(const double *) const {
+        return 0;
+    }
+    Node *to_node() const {
+        return new Node(0.0);
+    }
+};
+
+//! \brief Constant 1, derivates are folded by it at compile time
+struct One : Expr<One> {
+    constexpr double eval(const double *) const {
+        return 1;
+    }
+    Node *to_node() const {
+        return new Node(1.0);
+    }
+};
+
+struct Const : Expr<Const> {
+    double value;
+    constexpr explicit Const(double _value) : value(_value) {}
+    constexpr double eval(const double *) const {
+        return value;
+    }
+    Node *to_node() const {
+        return new Node(value);
+    }
+};
+
+template <char Name>
+struct Var : Expr<Var<Name>> {
+    constexpr double eval(const double *values) const {
+        return values[(int)Name];
+    }
+    Node *to_node() const {
+        const char name[] = {Name, '\0'};
+        return new Node(VAR, name);
+    }
+};
+
+//! \brief Calculate operation as get_val does
+constexpr double
+expr_calculate(int operation, double first, double second) {
+    switch (operation) {
+        case ADD:
+            return first + second;
+        case SUB:
+            return first - second;
+        case MUL:
+            return first * second;
+        case DIV:
+            return first / second;
+        case POWER:
+            return pow(first, second);
+        case LN:
+            return log(first);
+        case SIN:
+            return sin(first);
+        case COS:
+            return cos(first);
+        default:
+            return NAN;
+    }
+}
+
+//! \brief ADD, SUB, MUL, DIV or POWER of two expressions
+template <int Operation, class A, class B>
+struct Binary : Expr<Binary<Operation, A, B>> {
+    A first;
+    B second;
+    constexpr Binary(const A &_first, const B &_second) : first(_first), second(_second) {}
+    constexpr double eval(const double *values) const {
+        return expr_calculate(Operation, first.eval(values), second.eval(values));
+    }
+    Node *to_node() const {
+        Node *root = new Node(Operation);
+        root->add_child(first.to_node());
+        root->add_child(second.to_node());
+        return root;
+    }
+};
+
+//! \brief LN, SIN or COS of expression
+template <int Operation, class A>
+struct Unary : Expr<Unary<Operation, A>> {
+    A operand;
+    constexpr explicit Unary(const A &_operand) : operand(_operand) {}
+    constexpr double eval(const double *values) const {
+        return expr_calculate(Operation, operand.eval(values), 0);
+    }
+    Node *to_node() const {
+        Node *root = new Node(Operation);
+        root->add_child(operand.to_node());
+        return root;
+    }
+};
+
+template <class A, class B> using Add = Binary<ADD, A, B>;
+template <class A, class B> using Sub = Binary<SUB, A, B>;
+template <class A, class B> using Mul = Binary<MUL, A, B>;
+template <class A, class B> using Div = Binary<DIV, A, B>;
+template <class A, class B> using Pow = Binary<POWER, A, B>;
+template <class A> using Ln = Unary<LN, A>;
+template <class A> using Sin = Unary<SIN, A>;
+template <class A> using Cos = Unary<COS, A>;
+
+#define EXPR_BINARY_OPERATOR(name, operation)                                               \
+template <class A, class B>                                                                 \
+constexpr Binary<operation, A, B> name(const Expr<A> &first, const Expr<B> &second) {      \
+    return Binary<operation, A, B>(first.self(), second.self());                            \
+}                                                                                           \
+template <class A>                                                                          \
+constexpr Binary<operation, A, Const> name(const Expr<A> &first, double second) {          \
+    return Binary<operation, A, Const>(first.self(), Const(second));                        \
+}                                                                                           \
+template <class B>                                                                          \
+constexpr Binary<operation, Const, B> name(double first, const Expr<B> &second) {          \
+    return Binary<operation, Const, B>(Const(first), second.self());                        \
+}
+EXPR_BINARY_OPERATOR(operator+, ADD)
+EXPR_BINARY_OPERATOR(operator-, SUB)
+EXPR_BINARY_OPERATOR(operator*, MUL)
+EXPR_BINARY_OPERATOR(operator/, DIV)
+EXPR_BINARY_OPERATOR(pow, POWER)
+#undef EXPR_BINARY_OPERATOR
+
+template <class A>
+constexpr Ln<A> ln(const Expr<A> &operand) {
+    return Ln<A>(operand.self());
+}
+
+template <class A>
+constexpr Sin<A> sin(const Expr<A> &operand) {
+    return Sin<A>(operand.self());
+}
+
+template <class A>
+constexpr Cos<A> cos(const Expr<A> &operand) {
+    return Cos<A>(operand.self());
+}
+
+// Constructors of derivates: zeros and ones are folded, so they do not reach runtime
+template <class A, class B>
+constexpr Add<A, B> expr_add(const A &first, const B &second) {
+    return Add<A, B>(first, second);
+}
+template <class B>
+constexpr B expr_add(const Zero &, const B &second) {
+    return second;
+}
+template <class A>
+constexpr A expr_add(const A &first, const Zero &) {
+    return first;
+}
+constexpr Zero expr_add(const Zero &, const Zero &) {
+    return Zero();
+}
+
+template <class A, class B>
+constexpr Sub<A, B> expr_sub(const A &first, const B &second) {
+    return Sub<A, B>(first, second);
+}
+template <class A>
+constexpr A expr_sub(const A &first, const Zero &) {
+    return first;
+}
+constexpr Zero expr_sub(const Zero &, const Zero &) {
+    return Zero();
+}
+
+template <class A, class B>
+constexpr Mul<A, B> expr_mul(const A &first, const B &second) {
+    return Mul<A, B>(first, second);
+}
+template <class B>
+constexpr Zero expr_mul(const Zero &, const B &) {
+    return Zero();
+}
+template <class A>
+constexpr Zero expr_mul(const A &, const Zero &) {
+    return Zero();
+}
+template <class B>
+constexpr B expr_mul(const One &, const B &second) {
+    return second;
+}
+template <class A>
+constexpr A expr_mul(const A &first, const One &) {
+    return first;
+}
+constexpr Zero expr_mul(const Zero &, const Zero &) {
+    return Zero();
+}
+constexpr Zero expr_mul(const Zero &, const One &) {
+    return Zero();
+}
+constexpr Zero expr_mul(const One &, const Zero &) {
+    return Zero();
+}
+constexpr One expr_mul(const One &, const One &) {
+    return One();
+}
+
+template <class A, class B>
+constexpr Div<A, B> expr_div(const A &first, const B &second) {
+    return Div<A, B>(first, second);
+}
+template <class B>
+constexpr Zero expr_div(const Zero &, const B &) {
+    return Zero();
+}
+template <class A>
+constexpr A expr_div(const A &first, const One &) {
+    return first;
+}
+constexpr Zero expr_div(const Zero &, const One &) {
+    return Zero();
+}
+
+//! \brief Derivates by the same rules as Node::derivate, the type of the result
+//! is found at compile time. Use: expr_derivate<'x'>(func)
+template <char V>
+constexpr Zero expr_derivate(const Zero &) {
+    return Zero();
+}
+
+template <char V>
+constexpr Zero expr_derivate(const One &) {
+    return Zero();
+}
+
+template <char V>
+constexpr Zero expr_derivate(const Const &) {
+    return Zero();
+}
+
+template <char V, char Name>
+constexpr typename Expr_Select<V == Name, One, Zero>::type expr_derivate(const Var<Name> &) {
+    return typename Expr_Select<V == Name, One, Zero>::type();
+}
+
+// (a + b)` = a` + b`
+template <char V, class A, class B>
+constexpr auto expr_derivate(const Add<A, B> &func) {
+    return expr_add(expr_derivate<V>(func.first), expr_derivate<V>(func.second));
+}
+
+// (a - b)` = a` - b`
+template <char V, class A, class B>
+constexpr auto expr_derivate(const Sub<A, B> &func) {
+    return expr_sub(expr_derivate<V>(func.first), expr_derivate<V>(func.second));
+}
+
+// (a * b)` = a` * b + a * b`
+template <char V, class A, class B>
+constexpr auto expr_derivate(const Mul<A, B> &func) {
+    return expr_add(expr_mul(expr_derivate<V>(func.first), func.second),
+                    expr_mul(func.first, expr_derivate<V>(func.second)));
+}
+
+// (a / b)` = (a` * b - a * b`) / (b * b)
+template <char V, class A, class B>
+constexpr auto expr_derivate(const Div<A, B> &func) {
+    return expr_div(expr_sub(expr_mul(expr_derivate<V>(func.first), func.second),
+                             expr_mul(func.first, expr_derivate<V>(func.second))),
+                    expr_mul(func.second, func.second));
+}
+
+// (x ^ C)` = C * (x ^ (C - 1)) * x`
+template <char V, class A>
+constexpr auto expr_derivate(const Pow<A, Const> &func) {
+    return expr_mul(expr_mul(func.second, Pow<A, Const>(func.first, Const(func.second.value - 1))),
+                    expr_derivate<V>(func.first));
+}
+
+// (f ^ g)` = (f ^ g) * g` * ln(f) + (f ^ (g - 1)) * g * f`
+template <char V, class A, class B>
+constexpr auto expr_derivate(const Pow<A, B> &func) {
+    return expr_add(expr_mul(expr_mul(func, expr_derivate<V>(func.second)), Ln<A>(func.first)),
+                    expr_mul(expr_mul(Pow<A, Sub<B, One>>(func.first, Sub<B, One>(func.second, One())),
+                                      func.second),
+                             expr_derivate<V>(func.first)));
+}
+
+// (ln x)` = x` / x
+template <char V, class A>
+constexpr auto expr_derivate(const Ln<A> &func) {
+    return expr_div(expr_derivate<V>(func.operand), func.operand);
+}
+
+// (sin x)` = (cos x) * x`
+template <char V, class A>
+constexpr auto expr_derivate(const Sin<A> &func) {
+    return expr_mul(Cos<A>(func.operand), expr_derivate<V>(func.operand));
+}
+
+// (cos x)` = (-1) * sin (x) * x`
+template <char V, class A>
+constexpr auto expr_derivate(const Cos<A> &func) {
+    return expr_mul(expr_mul(Const(-1.0), Sin<A>(func.operand)), expr_derivate<V>(func.operand));
+}
+#endif
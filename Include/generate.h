@@ -0,0 +1,27 @@
+#ifndef GENERATE_H
+#define GENERATE_H
+//! \brief Shape of generated input
+struct Gen_Params {
+    long nodes;                // approximate number of tree nodes to emit
+    int depth;                 // maximal depth of expression tree (or of statement nesting)
+    int fanout;                // maximal number of operands of ADD, SUB, MUL, DIV, POWER
+    const char *ops;           // operation mix, each symbol once per weight unit: "+-*/^" and s(in), c(os), l(n)
+    int vars;                  // number of different variables
+    unsigned long long seed;   // same seed gives the same output
+};
+
+void gen_default_params(struct Gen_Params *params);
+long gen_expression(FILE *out, struct Gen_Params *params);
+long gen_program(FILE *out, struct Gen_Params *params);
+long gen_columns(FILE *out, struct Gen_Params *params);
+
+constexpr long GEN_DEFAULT_NODES = 1000;
+constexpr int GEN_DEFAULT_DEPTH = 32;
+constexpr int GEN_DEFAULT_FANOUT = 2;
+constexpr int GEN_DEFAULT_VARS = 2;
+constexpr int GEN_STATEMENTS_IN_FUNC = 16;
+constexpr int GEN_EXPR_IN_STATEMENT = 9;
+constexpr double GEN_MIN_VALUE = 0.5;
+constexpr double GEN_MAX_VALUE = 1.5;
+constexpr long GEN_COLUMNS_BLOCK = 4096;
+#endif
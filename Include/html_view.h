@@ -0,0 +1,7 @@
+#ifndef HTML_VIEW_H
+#define HTML_VIEW_H
+int create_html(char *filename, Node *root);
+
+constexpr long HTML_CHUNK_NODES = 4096;     // node records in one chunk, loaded by one expansion
+constexpr int HTML_PAGE_CHILDREN = 1000;    // children shown at once, the rest by "more"
+#endif
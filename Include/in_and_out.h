@@ -1,4 +1,8 @@
 #ifndef IN_AND_OUT_H
 #define IN_AND_OUT_H
 char *mmap_file(char *file_in, int *file_in_size);
+char *mmap_file(char *file_in, long *file_size, bool sequential);
+char *mmap_out_file(char *file_out, long file_size);
+void release_pages(char *data, long begin, long end);
+bool match_option(char *arg, const char *name, char **value);
 #endif
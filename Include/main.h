@@ -5,4 +5,12 @@ constexpr int FILE_IN = 1;
 constexpr int SHOW_PNG = 2;
 constexpr int SHOW_PDF = 3;
 
+//! \brief Trees exported by one run
+enum Run_Outputs {
+    OUT_SOURCE = 0,
+    OUT_SIMP,
+    OUT_DER,
+    RUN_OUTPUTS
+};
+
 #endif
@@ -0,0 +1,10 @@
+#ifndef PARSE_CACHE_H
+#define PARSE_CACHE_H
+int parse_cache_open(const char *dir, long max_bytes);
+void parse_cache_close();
+Node *parse_cache_load(const char *text, long size, char **entry);
+int parse_cache_store(const char *entry, Node *root);
+
+constexpr long PARSE_CACHE_MAX_BYTES = 256L << 20;    // oldest entries are removed above it
+constexpr const char *PARSE_CACHE_DIR = "trees_parse"; // in $XDG_CACHE_HOME or ~/.cache
+#endif
@@ -0,0 +1,13 @@
+#ifndef PLOT_H
+#define PLOT_H
+int plot_svg(char *filename, Node *func, Node *der, int order, int var_id, double from, double to, int threads);
+int parse_plot_range(const char *str, double *from, double *to);
+
+constexpr int PLOT_INITIAL_POINTS = 64;
+constexpr int PLOT_MAX_DEPTH = 10;
+constexpr double PLOT_TOLERANCE = 1e-3;     // of the value range, less than a pixel
+constexpr int PLOT_MIN_POINTS_PER_THREAD = 256;
+constexpr int PLOT_WIDTH = 800;
+constexpr int PLOT_HEIGHT = 600;
+constexpr int PLOT_MARGIN = 40;
+#endif
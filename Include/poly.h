@@ -0,0 +1,8 @@
+#ifndef POLY_H
+#define POLY_H
+bool poly_normalize(Node *node);
+bool is_poly_operation(int operation);
+
+constexpr int POLY_MAX_POWER = 16;
+constexpr long POLY_MAX_EXPAND = 16;
+#endif
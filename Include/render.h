@@ -0,0 +1,12 @@
+#ifndef RENDER_H
+#define RENDER_H
+void render_jobs(int jobs);
+int render_spawn(const char *const *argv, int phase, char *input = NULL, long input_size = 0,
+                 const char *const *then = NULL, int then_phase = 0,
+                 const char *output = NULL, const char *cache_entry = NULL);
+int render_wait();
+
+constexpr int RENDER_MAX_JOBS = 64;     // processes in flight
+constexpr int RENDER_MAX_ARGS = 8;      // arguments of one command, with its name
+constexpr int RENDER_POLL_MS = 10;      // wait for pipes or exit of process
+#endif
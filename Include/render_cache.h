@@ -0,0 +1,13 @@
+#ifndef RENDER_CACHE_H
+#define RENDER_CACHE_H
+int render_cache_open(const char *dir, long max_bytes);
+void render_cache_close();
+bool render_cache_used();
+char *render_cache_entry(const char *tool, const char *args, const char *text, long size, const char *extension);
+bool render_cache_fetch(const char *entry, const char *out);
+int render_cache_store(const char *out, const char *entry);
+
+constexpr long RENDER_CACHE_MAX_BYTES = 256L << 20;   // oldest entries are removed above it
+constexpr const char *RENDER_CACHE_DIR = "trees_render";   // in $XDG_CACHE_HOME or ~/.cache
+constexpr int RENDER_CACHE_TOOLS = 8;                // identities of tools, found in PATH
+#endif
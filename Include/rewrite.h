@@ -0,0 +1,12 @@
+#ifndef REWRITE_H
+#define REWRITE_H
+struct Rule_Set;
+
+struct Rule_Set *compile_rules(const char *rules[][2], int rules_num);
+void free_rules(struct Rule_Set *set);
+struct Rule_Set *simplify_rules();
+bool rewrite_node(struct Rule_Set *set, Node *node);
+int rules_number(struct Rule_Set *set);
+Node *rule_pattern(struct Rule_Set *set, int rule);
+Node *rule_replacement(struct Rule_Set *set, int rule);
+#endif
@@ -0,0 +1,63 @@
+#ifndef STATS_H
+#define STATS_H
+enum Stat_Counters {
+    NODES_CREATED = 0,
+    NODES_FREED,
+    SIMPLIFY_ITERATIONS,
+    RULE_REMOVE_NEITRALS,
+    RULE_CALCULATE_VALUES,
+    RULE_UNION_LAYERS,
+    RULE_TRANSFORM_CONSTANTS,
+    RULE_TRANSFORM_VARS,
+    RULE_SIMP_VAR,
+    RULE_REWRITE,
+    RULE_POLY_NORMAL_FORM,
+    EGRAPH_ITERATIONS,
+    EGRAPH_NODES,
+    CSE_SHARED,
+    PLOT_POINTS,
+    SIMPLIFY_CACHE_HITS,
+    LAZY_EXPANDED,
+    LAZY_SKIPPED,
+    BATCH_POINTS,
+    BATCH_STEALS,
+    BYTES_WRITTEN,
+    SUBPROCESS_CALLS,
+    SUBPROCESS_FAILED,
+    RENDER_CACHE_HITS,
+    RENDER_CACHE_MISSES,
+    RENDER_CACHE_EVICTED,
+    PARSE_CACHE_HITS,
+    PARSE_CACHE_MISSES,
+    PARSE_CACHE_EVICTED,
+    STAT_COUNTERS_NUM
+};
+
+enum Stat_Phases {
+    PHASE_TOTAL = 0,
+    PHASE_PARSE,
+    PHASE_SIMPLIFY,
+    PHASE_DERIVATE,
+    PHASE_EXPORT_DOT,
+    PHASE_EXPORT_TEX,
+    PHASE_EXPORT_HTML,
+    PHASE_DOT,
+    PHASE_PDFTEX,
+    PHASE_VIEWER,
+    PHASE_PLOT,
+    PHASE_EVAL,
+    STAT_PHASES_NUM
+};
+
+extern long long stat_counters[STAT_COUNTERS_NUM];
+
+#define STAT_INC(counter) (stat_counters[(counter)]++)
+#define STAT_ADD(counter, num) (stat_counters[(counter)] += (num))
+
+long long stats_now();
+long long stats_begin(int phase);
+void stats_add_time(int phase, long long start);
+void stats_add_async(int phase, long long start, long arg);
+int stats_dump_json(int fd, const char *program, const char *input);
+int stats_write(char *filename, const char *program, const char *input);
+#endif
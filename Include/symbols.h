@@ -0,0 +1,10 @@
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+int intern_symbol(const char *name, int name_len);
+int intern_symbol(const char *name);
+const char *symbol_name(int id);
+int symbol_len(int id);
+int symbols_number();
+
+constexpr int SYMBOL_NONE = -1;
+#endif
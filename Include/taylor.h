@@ -0,0 +1,10 @@
+#ifndef TAYLOR_H
+#define TAYLOR_H
+int taylor_coefs(Node *root, int var_id, double point, const double *values, int values_num,
+                 int order, double *coefs);
+int taylor_derivatives(Node *root, int var_id, double point, const double *values, int values_num,
+                       int order, double *ders);
+Node *derivate_order(Node *root, int var_id, int order);
+
+constexpr int TAYLOR_MAX_ORDER = 64;
+#endif
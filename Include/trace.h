@@ -0,0 +1,17 @@
+#ifndef TRACE_H
+#define TRACE_H
+extern bool trace_enabled;
+extern int trace_min_nodes;
+
+void trace_begin(const char *name, long arg = -1);
+void trace_end(const char *name);
+void trace_complete(const char *name, long long start_ns, long arg = -1);
+int trace_write(char *filename);
+
+// Event names are not copied, so only string literals may be passed
+#define TRACE_BEGIN(name) { if (trace_enabled) trace_begin(name); }
+#define TRACE_END(name) { if (trace_enabled) trace_end(name); }
+
+constexpr int TRACE_DEFAULT_MIN_NODES = 64;
+constexpr int TRACE_CHUNK_EVENTS = 4096;
+#endif
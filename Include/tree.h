@@ -1,46 +1,73 @@
 #ifndef TREE_H
 #define TREE_H
+constexpr int NODE_INLINE_CHILDREN = 3;    // children, stored in the node itself
+
+//! \brief Level of detail of export_dot: subtrees deeper than max_depth or
+//! beyond max_nodes are drawn as one summary node with their size and path
+struct Dot_Lod {
+    int max_depth;      // levels below the root, 0 for no limit
+    long max_nodes;     // drawn nodes, 0 for no limit
+    const char *path;   // path of exported subtree (child indexes "0.2.1"), NULL for the root
+};
+
 class Node
 {
 private:
     int children_number;
-    int node_id;
     Node *parent;
-    Node **childs;
+    Node **childs;          // inline_childs or heap array of children_capacity
+    int children_capacity;
     int operation;
     double value;
-    char *name;
-    int name_len;
+    int name_id;   // symbol id of var or function name, operation code for operations
+    Node *inline_childs[NODE_INLINE_CHILDREN];
+    void init_childs();
+    int reserve_children(int number);
+    void clear_children();
     int visualize(int fd);
-    double visualize_tree_rec(int fd);
+    double visualize_tree_rec(int fd, int *next_id);
+    double visualize_tree_lod(int fd, struct Lod_State *state);
     double visualize_tree_rec_tex(int fd);
     void remove_neitrals();
-    void specific_simpling();
     void calculate_values();
     void transform_constants();
-    void transform_vars(char *var_name);
+    void transform_vars(int var_id);
     void union_layers();
-    void simp_var(char *var_name);
-    char **get_node_vars(int *var_num);
+    void simp_var(int var_id);
+    int *get_node_vars(int *var_num);
+    void expand_simplified();
 public:
-    static int id;
     Node(int _operation);
-    Node(int _operation, char *name);
+    Node(int _operation, const char *name);
+    Node(int _operation, int name_id);
     Node(double _value);
     ~Node();
-    int export_dot(int fd, char *graph_name = NULL);
-    int export_tex(int fd);
+    Node(const Node &) = delete;            // childs may point into the node itself
+    Node &operator=(const Node &) = delete;
+    int export_dot(int fd, char *graph_name = NULL, const struct Dot_Lod *lod = NULL);
+    int export_tex(int fd, bool end = true);
     int add_child(Node *child);
     int get_children_number();
     int get_operation();
     int get_name_len();
-    char *get_name();
+    const char *get_name();
+    int get_name_id();
     double get_value();
     bool change_operation(int new_operation);
+    void replace_by(Node *other);
     Node *cut_child(int child_ind);
+    Node *find_path(const char *path);
+    Node *replace_child(int child_ind, Node *child);
+    int splice_children(int pos, Node *other);
+    int remove_children(bool (*cut)(Node *child, int child_ind, void *arg), void *arg, int first = 0);
     bool is_constant();
+    long get_size();
     Node *copy();
-    Node *derivate(char *var_name);
+    Node *derivate(const char *var_name);
+    Node *derivate(int var_id);
+    Node *derivate(const char *var_name, int order);
+    Node *derivate_lazy(int var_id);
+    void expand_lazy();
     void simplify();
     double get_val();
     bool tree_eq(Node *other);
@@ -69,11 +96,16 @@ enum Node_Types {
     DO_IN_ORDER,
     FUNC_CALL,
     FUNC_DEF,
-    RETURN
+    RETURN,
+    DERIVATE    // not expanded derivate of the only child, name_id is the variable
 };
 
 Node *parse_file_create_tree(char *filename);
+Node *parse_str_create_tree(char *str, int str_size);
+bool is_eq(double val1, double val2);
 void rec_del(Node *root);
+bool tree_same(Node *first, Node *second);
+unsigned long long tree_hash(Node *root, long *size = NULL);
 int get_neitral(int operation);
 int get_opposite(int operation);
 
@@ -0,0 +1,13 @@
+#ifndef TREE_CACHE_H
+#define TREE_CACHE_H
+struct Tree_Cache *tree_cache_create(long max_nodes);
+void tree_cache_free(struct Tree_Cache *cache);
+Node *tree_cache_find(struct Tree_Cache *cache, unsigned long long hash, int tag, Node *key);
+void tree_cache_put(struct Tree_Cache *cache, unsigned long long hash, int tag, Node *key, Node *value);
+
+extern struct Tree_Cache *simplify_cache;
+
+constexpr long TREE_CACHE_MIN_NODES = 16;
+constexpr long TREE_CACHE_MAX_SUBTREE = 256;    // bigger subtrees are simplified from cached parts
+constexpr long TREE_CACHE_MAX_NODES = 1 << 19;  // nodes of all keys and results
+#endif
@@ -1,7 +1,10 @@
 #ifndef VISUALIZE_H
 #define VISUALIZE_H
-int create_png(char *filename, Node *root, bool show);
+int create_png(char *filename, Node *root, bool show, bool shared = false, const struct Dot_Lod *lod = NULL);
 int create_pdf(char *filename, Node *root, int show);
+struct Tex_Doc *tex_doc_open(const char *name);
+int tex_doc_section(struct Tex_Doc *doc, const char *title);
+int tex_doc_add(struct Tex_Doc *doc, const char *caption, Node *root);
+int tex_doc_close(struct Tex_Doc *doc, int show);
 constexpr mode_t out_mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH;
-constexpr int BUFFER_SIZE = 200;
 #endif
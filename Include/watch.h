@@ -0,0 +1,6 @@
+#ifndef WATCH_H
+#define WATCH_H
+int watch_file(const char *filename, int (*on_change)(void *arg), void *arg);
+
+constexpr int WATCH_DEBOUNCE_MS = 30;
+#endif
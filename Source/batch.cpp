@@ -0,0 +1,159 @@
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <algorithm>
+
+#include "tree.h"
+#include "batch.h"
+#include "cse.h"
+#include "stats.h"
+
+//! \brief Chunks of one thread: it takes them from the front, others steal
+//! from the back. Aligned and allocated on cache line boundary (see
+//! batch_eval), so threads do not write into the same cache line
+struct alignas(BATCH_CACHE_LINE) Batch_Worker {
+    std::mutex lock;
+    long begin;         // chunk indexes [begin, end) left to calculate
+    long end;
+    long chunks;        // calculated by this thread
+    long steals;
+    int error;
+};
+
+//! \brief Task, shared by all threads (read only)
+struct Batch_Task {
+    struct Cse_Dag *dag;
+    const double *const *columns;
+    int columns_num;
+    long points;
+    int chunk_points;
+    double *res;
+    struct Batch_Worker *workers;
+    int threads;
+};
+
+//! \brief Number of points in one chunk: scratch of the chunk (value of every
+//! DAG node in every point) fits into BATCH_CACHE_BYTES
+int
+batch_chunk_points(struct Cse_Dag *dag) {
+    long nodes = std::max(1, cse_nodes_number(dag));
+    long points = BATCH_CACHE_BYTES / ((long)sizeof(double) * nodes);
+    return std::max((long)BATCH_MIN_CHUNK_POINTS, std::min((long)BATCH_MAX_CHUNK_POINTS, points));
+}
+
+//! \brief Take the next chunk of the thread
+//! \return Returns chunk index or -1, if the thread has no chunks
+static long
+take_chunk(struct Batch_Worker *worker) {
+    std::lock_guard<std::mutex> guard(worker->lock);
+    if (worker->begin >= worker->end) {
+        return -1;
+    }
+    return worker->begin++;
+}
+
+//! \brief Move the back half of chunks of other thread to this one
+//! \return Returns true, if something was stolen
+static bool
+steal_chunks(struct Batch_Task *task, int self) {
+    struct Batch_Worker *worker = &task->workers[self];
+    for (int i = 1; i < task->threads; i++) {
+        struct Batch_Worker *victim = &task->workers[(self + i) % task->threads];
+        long begin = 0, end = 0;
+        {
+            std::lock_guard<std::mutex> guard(victim->lock);
+            if (victim->begin >= victim->end) {
+                continue;
+            }
+            begin = victim->begin + (victim->end - victim->begin) / 2;
+            end = victim->end;
+            victim->end = begin;
+        }
+        std::lock_guard<std::mutex> guard(worker->lock);
+        worker->begin = begin;
+        worker->end = end;
+        worker->steals++;
+        return true;
+    }
+    return false;
+}
+
+//! \brief Thread: calculate own chunks, then steal, while somebody has chunks.
+//! Scratch memory is its own, results of chunks are disjoint parts of res
+static void
+batch_worker(struct Batch_Task *task, int self) {
+    struct Batch_Worker *worker = &task->workers[self];
+    std::vector<double> temps((long)cse_nodes_number(task->dag) * task->chunk_points);
+    do {
+        for (long chunk = take_chunk(worker); chunk >= 0; chunk = take_chunk(worker)) {
+            long first = chunk * task->chunk_points;
+            int count = std::min((long)task->chunk_points, task->points - first);
+            if (cse_eval_columns(task->dag, task->columns, task->columns_num, first, count,
+                                 temps.data(), task->res + first)) {
+                worker->error = 1;
+                return;
+            }
+            worker->chunks++;
+        }
+    } while (steal_chunks(task, self));
+}
+
+//! \brief Calculate expression in many points on several threads. Points are
+//! split into cache sized chunks, every thread starts with an equal range of
+//! them, and threads, which are done, steal halves of other ranges
+//! \param [in] dag Expression
+//! \param [in] columns Values of variables by symbol id: columns[id][i] is the
+//! value in point i, NULL for unbound variable
+//! \param [in] columns_num Size of columns
+//! \param [in] points Number of points
+//! \param [out] res Values in points
+//! \param [in] threads Number of threads
+//! \return Returns 0 in success -1 else
+int
+batch_eval(struct Cse_Dag *dag, const double *const *columns, int columns_num, long points,
+           double *res, int threads) {
+    if (!dag || !res || points < 0) {
+        return -1;
+    }
+    struct Batch_Task task = {dag, columns, columns_num, points, batch_chunk_points(dag), res, NULL, 0};
+    long chunks = (points + task.chunk_points - 1) / task.chunk_points;
+    task.threads = std::max(1L, std::min((long)threads, chunks));
+    // std::allocator of C++14 ignores alignas, so slots are allocated aligned here
+    struct Batch_Worker *workers = (struct Batch_Worker *)aligned_alloc(BATCH_CACHE_LINE,
+                                                                       task.threads * sizeof(*workers));
+    if (!workers) {
+        fprintf(stderr, "Can not allocate memory\n");
+        return -1;
+    }
+    task.workers = workers;
+    for (int t = 0; t < task.threads; t++) {
+        new (&workers[t]) Batch_Worker();
+        workers[t].begin = chunks * t / task.threads;
+        workers[t].end = chunks * (t + 1) / task.threads;
+        workers[t].chunks = 0;
+        workers[t].steals = 0;
+        workers[t].error = 0;
+    }
+    std::vector<std::thread> pool;
+    for (int t = 1; t < task.threads; t++) {
+        pool.push_back(std::thread(batch_worker, &task, t));
+    }
+    batch_worker(&task, 0);
+    int err = 0;
+    for (int t = 0; t < task.threads; t++) {
+        if (t) {
+            pool[t - 1].join();
+        }
+        err = err || workers[t].error;
+        STAT_ADD(BATCH_STEALS, workers[t].steals);
+    }
+    for (int t = 0; t < task.threads; t++) {
+        workers[t].~Batch_Worker();
+    }
+    free(workers);
+    STAT_ADD(BATCH_POINTS, points);
+    return err ? -1 : 0;
+}
@@ -0,0 +1,580 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <cerrno>
+#include <thread>
+#include <algorithm>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "tree.h"
+#include "bench.h"
+#include "generate.h"
+#include "in_and_out.h"
+#include "bin_tree.h"
+#include "egraph.h"
+#include "taylor.h"
+#include "cse.h"
+#include "symbols.h"
+#include "expr.h"
+#include "batch.h"
+
+// Every allocation of the measured code goes through malloc, calloc or realloc
+// (operator new included), so counting them here is enough for allocs/node.
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t num, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+
+static unsigned long long alloc_counter = 0;
+
+extern "C" void *
+malloc(size_t size) {
+    alloc_counter++;
+    return __libc_malloc(size);
+}
+
+extern "C" void *
+calloc(size_t num, size_t size) {
+    alloc_counter++;
+    return __libc_calloc(num, size);
+}
+
+extern "C" void *
+realloc(void *ptr, size_t size) {
+    alloc_counter++;
+    return __libc_realloc(ptr, size);
+}
+
+//! \brief Current monotonic time
+//! \return Returns time in nanoseconds
+static long long
+now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+//! \brief Peak resident set size of the process
+//! \return Returns peak RSS in kilobytes
+static long
+peak_rss_kb() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage)) {
+        return -1;
+    }
+    return usage.ru_maxrss;
+}
+
+//! \brief Count nodes in tree
+//! \param [in] root Tree root
+//! \return Returns number of nodes
+static long
+count_nodes(Node *root) {
+    if (!root) {
+        return 0;
+    }
+    long res = 1;
+    for (int i = 0; i < root->get_children_number(); i++) {
+        res += count_nodes(root->get_childs()[i]);
+    }
+    return res;
+}
+
+//! \brief Generate input into temporary file
+//! \param [in] params Generation parameters
+//! \param [in] program Generate rec_desc program instead of expression
+//! \param [out] filename Buffer for the file name (at least 32 symbols)
+//! \return Returns 0 in success, -1 else
+static int
+write_temp(struct Gen_Params *params, bool program, char *filename) {
+    strcpy(filename, "/tmp/tree_benchXXXXXX");
+    int fd = mkstemp(filename);
+    if (fd < 0) {
+        fprintf(stderr, "Can not create temporary file\n");
+        return -1;
+    }
+    FILE *out = fdopen(fd, "w");
+    if (!out) {
+        fprintf(stderr, "Can not open temporary file %s\n", filename);
+        close(fd);
+        unlink(filename);
+        return -1;
+    }
+    if (program) {
+        gen_program(out, params);
+    } else {
+        gen_expression(out, params);
+    }
+    if (fclose(out)) {
+        fprintf(stderr, "Can not write temporary file %s\n", filename);
+        unlink(filename);
+        return -1;
+    }
+    return 0;
+}
+
+//! \brief Measurement of one operation
+struct Bench_Result {
+    long long time_ns;
+    unsigned long long allocs;
+};
+
+static void
+bench_start(struct Bench_Result *res) {
+    res->allocs = alloc_counter;
+    res->time_ns = now_ns();
+}
+
+static void
+bench_stop(struct Bench_Result *res) {
+    res->time_ns = now_ns() - res->time_ns;
+    res->allocs = alloc_counter - res->allocs;
+}
+
+static void
+bench_report(const char *name, long nodes, int depth, int reps, struct Bench_Result *res) {
+    double per_node = (double)nodes * reps;
+    if (per_node <= 0) {
+        per_node = 1;
+    }
+    printf("%-24s %10ld %6d %6d %12.2f %12.3f %10ld\n", name, nodes, depth, reps,
+            res->time_ns / per_node, res->allocs / per_node, peak_rss_kb());
+    fflush(stdout);
+}
+
+//! \brief Save tree in binary format and measure loading
+//! \param [in] root Tree to save
+//! \param [in] nodes Nodes in tree
+//! \param [in] depth Depth of generated tree (for the report)
+//! \param [in] reps Repetitions
+static void
+bench_binary(Node *root, long nodes, int depth, int reps) {
+    char filename[32];
+    struct Bench_Result res;
+    strcpy(filename, "/tmp/tree_benchXXXXXX");
+    int fd = mkstemp(filename);
+    if (fd < 0) {
+        fprintf(stderr, "Can not create temporary file\n");
+        return;
+    }
+    bench_start(&res);
+    for (int i = 0; i < reps; i++) {
+        lseek(fd, 0, SEEK_SET);
+        write_bin_tree(fd, root);
+    }
+    bench_stop(&res);
+    close(fd);
+    bench_report("write_bin_tree", nodes, depth, reps, &res);
+
+    struct Bin_Tree *bin = NULL;
+    bench_start(&res);
+    for (int i = 0; i < reps; i++) {
+        unload_bin_tree(bin);
+        bin = load_bin_tree(filename);
+    }
+    bench_stop(&res);
+    bench_report("load_bin_tree", nodes, depth, reps, &res);
+
+    if (bin) {
+        Node *built = NULL;
+        bench_start(&res);
+        for (int i = 0; i < reps; i++) {
+            rec_del(built);
+            built = bin_build_tree(bin, 0);
+        }
+        bench_stop(&res);
+        bench_report("bin_build_tree", nodes, depth, reps, &res);
+        if (!built->tree_eq(root)) {
+            fprintf(stderr, "Tree loaded from binary file differs from the source\n");
+        }
+        rec_del(built);
+        unload_bin_tree(bin);
+    }
+    unlink(filename);
+}
+
+//! \brief Run all expression benchmarks for one input shape
+//! \param [in] nodes Node budget for generated expression
+//! \param [in] depth Maximal depth of generated expression
+//! \param [in] reps Repetitions of each measured operation
+static void
+bench_expression(int nodes, int depth, int reps) {
+    char filename[32];
+    struct Bench_Result res;
+    char var[] = "x";
+
+    struct Gen_Params params;
+    gen_default_params(&params);
+    params.nodes = nodes;
+    params.depth = depth;
+    // simplify can not handle '-' and '/' mixed with vars yet, so they are left for get_val
+    params.ops = "++++****scl";
+    if (write_temp(&params, false, filename)) {
+        return;
+    }
+
+    Node *root = NULL;
+    bench_start(&res);
+    for (int i = 0; i < reps; i++) {
+        rec_del(root);
+        root = parse_file_create_tree(filename);
+    }
+    bench_stop(&res);
+    unlink(filename);
+    if (!root) {
+        fprintf(stderr, "Can not parse generated expression\n");
+        return;
+    }
+    long real_nodes = count_nodes(root);
+    bench_report("parse_file_create_tree", real_nodes, depth, reps, &res);
+
+    bench_binary(root, real_nodes, depth, reps);
+
+    Node *tmp = NULL;
+    bench_start(&res);
+    for (int i = 0; i < reps; i++) {
+        rec_del(tmp);
+        tmp = root->copy();
+    }
+    bench_stop(&res);
+    bench_report("copy", real_nodes, depth, reps, &res);
+
+    bool eq = true;
+    bench_start(&res);
+    for (int i = 0; i < reps; i++) {
+        eq = eq && root->tree_eq(tmp);
+    }
+    bench_stop(&res);
+    bench_report("tree_eq", real_nodes, depth, reps, &res);
+    rec_del(tmp);
+    tmp = NULL;
+    if (!eq) {
+        fprintf(stderr, "Copied tree differs from the source\n");
+    }
+
+    int null_fd = open("/dev/null", O_WRONLY);
+    bench_start(&res);
+    for (int i = 0; i < reps; i++) {
+        root->export_dot(null_fd);
+    }
+    bench_stop(&res);
+    bench_report("export_dot", real_nodes, depth, reps, &res);
+
+    bench_start(&res);
+    for (int i = 0; i < reps; i++) {
+        root->export_tex(null_fd);
+    }
+    bench_stop(&res);
+    bench_report("export_tex", real_nodes, depth, reps, &res);
+    close(null_fd);
+
+    Node *der = NULL;
+    bench_start(&res);
+    for (int i = 0; i < reps; i++) {
+        rec_del(der);
+        der = root->derivate(var);
+    }
+    bench_stop(&res);
+    bench_report("derivate", real_nodes, depth, reps, &res);
+
+    // other variables are bound to a constant
+    int values_num = symbols_number();
+    double *values = (double *)calloc(values_num, sizeof(double));
+    for (int i = 0; i < values_num; i++) {
+        values[i] = 0.5;
+    }
+    double coefs[BENCH_TAYLOR_ORDER + 1] = {};
+    bench_start(&res);
+    for (int i = 0; i < reps; i++) {
+        taylor_coefs(root, intern_symbol(var), 0.5, values, values_num, BENCH_TAYLOR_ORDER, coefs);
+    }
+    bench_stop(&res);
+    bench_report("taylor_coefs", real_nodes, depth, reps, &res);
+
+    // derivate repeats operands of products, CSE shares them
+    long der_nodes = count_nodes(der);
+    struct Cse_Dag *dag = NULL;
+    bench_start(&res);
+    for (int i = 0; i < reps; i++) {
+        cse_free(dag);
+        dag = cse_build(der);
+    }
+    bench_stop(&res);
+    bench_report("cse_build(derivate)", der_nodes, depth, reps, &res);
+
+    volatile double val = 0;
+    bench_start(&res);
+    for (int i = 0; i < reps; i++) {
+        val = cse_eval(dag, values, values_num);
+    }
+    bench_stop(&res);
+    bench_report("cse_eval(derivate)", der_nodes, depth, reps, &res);
+    cse_free(dag);
+    rec_del(der);
+    free(values);
+
+    // simplify changes the tree, so each repetition works on a fresh copy
+    res.time_ns = 0;
+    res.allocs = 0;
+    for (int i = 0; i < reps; i++) {
+        struct Bench_Result one;
+        tmp = root->copy();
+        bench_start(&one);
+        tmp->simplify();
+        bench_stop(&one);
+        rec_del(tmp);
+        res.time_ns += one.time_ns;
+        res.allocs += one.allocs;
+    }
+    bench_report("simplify", real_nodes, depth, reps, &res);
+
+    bench_start(&res);
+    for (int i = 0; i < reps; i++) {
+        rec_del(egraph_simplify(root, COST_NODES, EGRAPH_MAX_NODES, EGRAPH_MAX_ITERATIONS));
+    }
+    bench_stop(&res);
+    bench_report("egraph_simplify", real_nodes, depth, reps, &res);
+    rec_del(root);
+
+    // get_val works only for expressions without vars
+    params.vars = 0;
+    params.ops = "+-*/scl";
+    if (write_temp(&params, false, filename)) {
+        return;
+    }
+    root = parse_file_create_tree(filename);
+    unlink(filename);
+    if (!root) {
+        fprintf(stderr, "Can not parse generated expression\n");
+        return;
+    }
+    real_nodes = count_nodes(root);
+    bench_start(&res);
+    for (int i = 0; i < reps; i++) {
+        val = root->get_val();
+    }
+    bench_stop(&res);
+    (void)val;
+    bench_report("get_val", real_nodes, depth, reps, &res);
+
+    strcpy(filename, "/tmp/tree_benchXXXXXX");
+    int fd = mkstemp(filename);
+    if (fd >= 0 && !write_bin_tree(fd, root)) {
+        struct Bin_Tree *bin = load_bin_tree(filename);
+        if (bin) {
+            bench_start(&res);
+            for (int i = 0; i < reps; i++) {
+                val = bin_get_val(bin, 0);
+            }
+            bench_stop(&res);
+            bench_report("bin_get_val", real_nodes, depth, reps, &res);
+            unload_bin_tree(bin);
+        }
+    }
+    if (fd >= 0) {
+        close(fd);
+        unlink(filename);
+    }
+    rec_del(root);
+}
+
+//! \brief Fixed formula and its derivate as expression templates against
+//! the same trees (built by to_node), evaluated by cse_eval
+//! \param [in] reps Repetitions, each one evaluates BENCH_EXPR_POINTS points
+static void
+bench_templates(int reps) {
+    struct Bench_Result res;
+    Var<'x'> x;
+    Var<'y'> y;
+    auto func = sin(x) * pow(x, 3.0) + ln(x + 2.0) / (x * y) + cos(x * y);
+    auto der = expr_derivate<'x'>(func);
+    Node *tree = func.to_node();
+    Node *der_tree = tree->derivate("x");
+    long der_nodes = count_nodes(der_tree);
+    struct Cse_Dag *dag = cse_build(der_tree);
+
+    double values[EXPR_VALUES_NUM] = {};
+    int symbol_values_num = symbols_number();
+    double *symbol_values = (double *)calloc(symbol_values_num, sizeof(double));
+    int x_id = intern_symbol("x");
+    values['y'] = symbol_values[intern_symbol("y")] = 0.5;
+    volatile double sum = 0;
+    bench_start(&res);
+    for (int i = 0; i < reps; i++) {
+        for (int j = 0; j < BENCH_EXPR_POINTS; j++) {
+            values['x'] = 1 + (double)j / BENCH_EXPR_POINTS;
+            sum = sum + der.eval(values);
+        }
+    }
+    bench_stop(&res);
+    bench_report("expr_eval(derivate)", der_nodes * BENCH_EXPR_POINTS, 0, reps, &res);
+    double expr_sum = sum;
+
+    sum = 0;
+    bench_start(&res);
+    for (int i = 0; i < reps; i++) {
+        for (int j = 0; j < BENCH_EXPR_POINTS; j++) {
+            symbol_values[x_id] = 1 + (double)j / BENCH_EXPR_POINTS;
+            sum = sum + cse_eval(dag, symbol_values, symbol_values_num);
+        }
+    }
+    bench_stop(&res);
+    bench_report("cse_eval(expr derivate)", der_nodes * BENCH_EXPR_POINTS, 0, reps, &res);
+    if (fabs(expr_sum - sum) > 1e-6 * fabs(sum)) {
+        fprintf(stderr, "Derivate of expression template differs from Node::derivate\n");
+    }
+    cse_free(dag);
+    free(symbol_values);
+    rec_del(der_tree);
+    rec_del(tree);
+}
+
+//! \brief Parallel evaluation of generated expression in BENCH_BATCH_POINTS
+//! points by 1, 2, 4, ... threads (up to the number of cpus) with scaling
+//! efficiency: time of one thread / (threads * time)
+//! \param [in] reps Repetitions
+static void
+bench_batch(int reps) {
+    char filename[32];
+    struct Bench_Result res;
+    struct Gen_Params params;
+    gen_default_params(&params);
+    params.nodes = BENCH_BATCH_NODES;
+    params.depth = BENCH_DEPTHS[0];
+    if (write_temp(&params, false, filename)) {
+        return;
+    }
+    Node *root = parse_file_create_tree(filename);
+    unlink(filename);
+    if (!root) {
+        fprintf(stderr, "Can not parse generated expression\n");
+        return;
+    }
+    long nodes = count_nodes(root);
+    struct Cse_Dag *dag = cse_build(root);
+    rec_del(root);
+
+    // every variable gets its own column
+    int columns_num = symbols_number();
+    double *data = (double *)calloc(BENCH_BATCH_POINTS, sizeof(double));
+    const double **columns = (const double **)calloc(columns_num, sizeof(*columns));
+    double *values = (double *)calloc(BENCH_BATCH_POINTS, sizeof(double));
+    for (long i = 0; i < BENCH_BATCH_POINTS; i++) {
+        data[i] = 0.5 + (double)i / BENCH_BATCH_POINTS;
+    }
+    for (int i = 0; i < columns_num; i++) {
+        columns[i] = data;
+    }
+
+    int max_threads = std::max(1U, std::thread::hardware_concurrency());
+    double single_ns = 0;
+    char name[32];
+    char scaling[256] = "";
+    int scaling_len = 0;
+    for (int threads = 1; ; threads = std::min(threads * 2, max_threads)) {
+        bench_start(&res);
+        for (int i = 0; i < reps; i++) {
+            batch_eval(dag, columns, columns_num, BENCH_BATCH_POINTS, values, threads);
+        }
+        bench_stop(&res);
+        snprintf(name, sizeof(name), "batch_eval(%d threads)", threads);
+        bench_report(name, nodes * BENCH_BATCH_POINTS, params.depth, reps, &res);
+        if (threads == 1) {
+            single_ns = res.time_ns;
+        }
+        scaling_len += snprintf(scaling + scaling_len, sizeof(scaling) - scaling_len, " %d:%.2f", threads,
+                                single_ns / ((double)threads * res.time_ns));
+        if (threads == max_threads || scaling_len >= (int)sizeof(scaling)) {
+            break;
+        }
+    }
+    printf("batch_eval scaling efficiency (threads:efficiency):%s\n", scaling);
+    cse_free(dag);
+    free(data);
+    free(columns);
+    free(values);
+}
+
+//! \brief Run Parse_All benchmark for one program shape
+//! \param [in] nodes Node budget for generated program
+//! \param [in] depth Maximal nesting of statements
+//! \param [in] reps Repetitions
+static void
+bench_program(int nodes, int depth, int reps) {
+    char filename[32];
+    struct Bench_Result res;
+    struct Gen_Params params;
+    gen_default_params(&params);
+    params.nodes = nodes;
+    params.depth = depth;
+    if (write_temp(&params, true, filename)) {
+        return;
+    }
+    int size = 0;
+    char *program = mmap_file(filename, &size);
+    unlink(filename);
+    if (!program) {
+        return;
+    }
+    // Parse_All needs '$' after the program, as in main_rec
+    char *str = (char *)calloc(size + 1, sizeof(char));
+    memcpy(str, program, size);
+    str[size] = '$';
+    munmap(program, size);
+
+    Node *root = NULL;
+    bench_start(&res);
+    for (int i = 0; i < reps; i++) {
+        rec_del(root);
+        root = Parse_All(str, size + 1);
+    }
+    bench_stop(&res);
+    free(str);
+    if (!root) {
+        fprintf(stderr, "Can not parse generated program\n");
+        return;
+    }
+    bench_report("Parse_All", count_nodes(root), depth, reps, &res);
+    rec_del(root);
+}
+
+int
+main(int argc, char **argv) {
+    int max_nodes = BENCH_MAX_NODES;
+    int reps = BENCH_REPS;
+    if (argc > 1) {
+        errno = 0;
+        max_nodes = strtol(argv[1], NULL, 10);
+        if (errno || max_nodes <= 0) {
+            fprintf(stderr, "Wrong input argument %s: expected positive int (max nodes)\n", argv[1]);
+            return 1;
+        }
+    }
+    if (argc > 2) {
+        errno = 0;
+        reps = strtol(argv[2], NULL, 10);
+        if (errno || reps <= 0) {
+            fprintf(stderr, "Wrong input argument %s: expected positive int (repetitions)\n", argv[2]);
+            return 1;
+        }
+    }
+
+    printf("%-24s %10s %6s %6s %12s %12s %10s\n", "operation", "nodes", "depth", "reps",
+            "ns/node", "allocs/node", "rss_kb");
+    for (int nodes = BENCH_MIN_NODES; nodes <= max_nodes; nodes *= BENCH_STEP) {
+        for (int d = 0; d < BENCH_DEPTHS_NUM; d++) {
+            bench_expression(nodes, BENCH_DEPTHS[d], reps);
+        }
+    }
+    for (int nodes = BENCH_MIN_NODES; nodes <= max_nodes; nodes *= BENCH_STEP) {
+        bench_program(nodes, BENCH_PROGRAM_DEPTH, reps);
+    }
+    bench_templates(reps);
+    bench_batch(reps);
+    return 0;
+}
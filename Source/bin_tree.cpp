@@ -0,0 +1,430 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "tree.h"
+#include "bin_tree.h"
+#include "in_and_out.h"
+
+//! \brief Buffers, filled during preorder walk of the tree
+struct Bin_Writer {
+    std::vector<struct Bin_Node> nodes;
+    std::vector<double> consts;
+    std::vector<uint32_t> name_offsets;
+    std::string names;
+    std::unordered_map<std::string, uint32_t> name_ids;
+};
+
+//! \brief Check, if node keeps its own name (not defined by the operation)
+static bool
+has_own_name(int operation) {
+    return operation == VAR || operation == FUNC_CALL || operation == FUNC_DEF;
+}
+
+//! \brief Get index of the name in the name table, add it if necessary
+//! \param [in] writer Writer buffers
+//! \param [in] name Name to intern
+//! \return Returns name index
+static uint32_t
+intern_name(struct Bin_Writer *writer, const char *name) {
+    std::string key(name ? name : "");
+    auto found = writer->name_ids.find(key);
+    if (found != writer->name_ids.end()) {
+        return found->second;
+    }
+    uint32_t ind = writer->name_offsets.size();
+    writer->name_ids[key] = ind;
+    writer->name_offsets.push_back(writer->names.size());
+    writer->names += key;
+    writer->names += '\0';
+    return ind;
+}
+
+//! \brief Add subtree in preorder
+//! \param [in] writer Writer buffers
+//! \param [in] root Subtree root
+static void
+add_node(struct Bin_Writer *writer, Node *root) {
+    size_t ind = writer->nodes.size();
+    struct Bin_Node node;
+    memset(&node, 0, sizeof(node));
+    node.operation = root->get_operation();
+    node.children_number = root->get_children_number();
+    node.operand = BIN_NO_OPERAND;
+    if (node.operation == CONSTANT) {
+        node.operand = writer->consts.size();
+        writer->consts.push_back(root->get_value());
+    } else if (has_own_name(node.operation)) {
+        node.operand = intern_name(writer, root->get_name());
+    }
+    writer->nodes.push_back(node);
+    for (int i = 0; i < root->get_children_number(); i++) {
+        add_node(writer, root->get_childs()[i]);
+    }
+    writer->nodes[ind].subtree_size = writer->nodes.size() - ind;
+}
+
+static uint64_t
+align8(uint64_t size) {
+    return (size + 7) & ~(uint64_t)7;
+}
+
+//! \brief Write all bytes with padding up to 'total'
+static int
+write_part(int fd, const void *data, uint64_t size, uint64_t total) {
+    static const char zeros[8] = {};
+    const char *ptr = (const char *)data;
+    while (size > 0) {
+        ssize_t res = write(fd, ptr, size);
+        if (res <= 0) {
+            return -1;
+        }
+        ptr += res;
+        size -= res;
+        total -= res;
+    }
+    if (total && write(fd, zeros, total) != (ssize_t)total) {
+        return -1;
+    }
+    return 0;
+}
+
+//! \brief Write tree in binary format
+//! \param [in] fd File descriptor
+//! \param [in] root Tree root
+//! \return Returns 0 in success, -1 else
+int
+write_bin_tree(int fd, Node *root) {
+    if (!root || fd < 0) {
+        return -1;
+    }
+    struct Bin_Writer writer;
+    add_node(&writer, root);
+    writer.name_offsets.push_back(writer.names.size()); // end of the last name
+
+    struct Bin_Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BIN_MAGIC, sizeof(BIN_MAGIC));
+    header.version = BIN_VERSION;
+    header.nodes_num = writer.nodes.size();
+    header.consts_num = writer.consts.size();
+    header.names_num = writer.name_offsets.size() - 1;
+    header.names_size = writer.names.size();
+    header.consts_offset = align8(sizeof(header));
+    header.nodes_offset = header.consts_offset + align8(writer.consts.size() * sizeof(double));
+    header.name_offsets_offset = header.nodes_offset + align8(writer.nodes.size() * sizeof(struct Bin_Node));
+    header.names_offset = header.name_offsets_offset + align8(writer.name_offsets.size() * sizeof(uint32_t));
+
+    if (write_part(fd, &header, sizeof(header), header.consts_offset) ||
+        write_part(fd, writer.consts.data(), writer.consts.size() * sizeof(double),
+            header.nodes_offset - header.consts_offset) ||
+        write_part(fd, writer.nodes.data(), writer.nodes.size() * sizeof(struct Bin_Node),
+            header.name_offsets_offset - header.nodes_offset) ||
+        write_part(fd, writer.name_offsets.data(), writer.name_offsets.size() * sizeof(uint32_t),
+            header.names_offset - header.name_offsets_offset) ||
+        write_part(fd, writer.names.data(), writer.names.size(), align8(writer.names.size()))) {
+        fprintf(stderr, "Can not write binary tree\n");
+        return -1;
+    }
+    return 0;
+}
+
+//! \brief Write tree in binary format into file
+//! \param [in] filename Output file
+//! \param [in] root Tree root
+//! \return Returns 0 in success, -1 else
+int
+save_bin_tree(char *filename, Node *root) {
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (fd < 0) {
+        fprintf(stderr, "Can not open file %s\n", filename);
+        return -1;
+    }
+    int res = write_bin_tree(fd, root);
+    if (close(fd)) {
+        res = -1;
+    }
+    return res;
+}
+
+//! \brief Check, that count elements of elem_size bytes at offset are inside the file
+static bool
+part_fits(uint64_t offset, uint64_t count, uint64_t elem_size, uint64_t size) {
+    return offset <= size && count <= (size - offset) / elem_size;
+}
+
+//! \brief Check number of children of the operation, so calculation and
+//! building of Node never read absent children
+static bool
+check_arity(uint8_t operation, uint32_t children) {
+    switch (operation) {
+        case CONSTANT:
+        case VAR:
+            return children == 0;
+        case LN:
+        case SIN:
+        case COS:
+        case RETURN:
+        case DERIVATE:
+            return children == 1;
+        case ADD:
+        case SUB:
+        case MUL:
+        case DIV:
+        case POWER:
+            return children >= 2;
+        case ASSIGNMENT:
+        case MORE:
+        case LESS:
+        case EQ:
+        case WHILE:
+            return children == 2;
+        case IF:
+            return children == 2 || children == 3;
+        case FOR:
+            return children == 4;
+        case DO_IN_ORDER:
+        case FUNC_CALL:
+        case FUNC_DEF:
+            return true;
+        default:
+            return false;
+    }
+}
+
+//! \brief Check, that all parts of the file are inside it and all references are correct
+//! \param [in] tree Loaded tree
+//! \return Returns true, if tree can be used
+static bool
+check_bin_tree(struct Bin_Tree *tree) {
+    const struct Bin_Header *header = tree->header;
+    uint64_t size = tree->size;
+    if (size < sizeof(*header) || memcmp(header->magic, BIN_MAGIC, sizeof(BIN_MAGIC))) {
+        fprintf(stderr, "Not a binary tree file\n");
+        return false;
+    }
+    if (header->version != BIN_VERSION) {
+        fprintf(stderr, "Unsupported binary tree version %u\n", header->version);
+        return false;
+    }
+    if (header->consts_offset % 8 || header->nodes_offset % 8 || header->name_offsets_offset % 8 ||
+        !part_fits(header->consts_offset, header->consts_num, sizeof(double), size) ||
+        !part_fits(header->nodes_offset, header->nodes_num, sizeof(struct Bin_Node), size) ||
+        !part_fits(header->name_offsets_offset, (uint64_t)header->names_num + 1, sizeof(uint32_t), size) ||
+        !part_fits(header->names_offset, header->names_size, 1, size) || !header->nodes_num) {
+        fprintf(stderr, "Broken binary tree file: wrong sizes\n");
+        return false;
+    }
+    for (uint32_t i = 0; i <= header->names_num; i++) {
+        if (tree->name_offsets[i] > header->names_size || (i && tree->name_offsets[i] < tree->name_offsets[i - 1])) {
+            fprintf(stderr, "Broken binary tree file: wrong name table\n");
+            return false;
+        }
+    }
+    if (header->names_size && tree->names[header->names_size - 1] != '\0') {
+        fprintf(stderr, "Broken binary tree file: wrong name table\n");
+        return false;
+    }
+    if (tree->nodes[0].subtree_size != header->nodes_num) {
+        fprintf(stderr, "Broken binary tree file: wrong root\n");
+        return false;
+    }
+    for (uint32_t i = 0; i < header->nodes_num; i++) {
+        const struct Bin_Node *node = &tree->nodes[i];
+        if (!node->subtree_size || node->subtree_size > header->nodes_num - i) {
+            fprintf(stderr, "Broken binary tree file: wrong node %u\n", i);
+            return false;
+        }
+        if ((node->operation == CONSTANT && node->operand >= header->consts_num) ||
+            (has_own_name(node->operation) && node->operand >= header->names_num)) {
+            fprintf(stderr, "Broken binary tree file: wrong operand of node %u\n", i);
+            return false;
+        }
+        if (node->operation > DERIVATE || !check_arity(node->operation, node->children_number)) {
+            fprintf(stderr, "Broken binary tree file: wrong operation or children number of node %u\n", i);
+            return false;
+        }
+        // children must exactly fill the subtree
+        uint32_t child = i + 1;
+        for (uint32_t j = 0; j < node->children_number; j++) {
+            if (child >= i + node->subtree_size) {
+                fprintf(stderr, "Broken binary tree file: wrong children of node %u\n", i);
+                return false;
+            }
+            child += tree->nodes[child].subtree_size;
+        }
+        if (child != i + node->subtree_size) {
+            fprintf(stderr, "Broken binary tree file: wrong children of node %u\n", i);
+            return false;
+        }
+    }
+    return true;
+}
+
+//! \brief Load binary tree with one mmap. The tree can be used as is, without building Node objects
+//! \param [in] filename Input file
+//! \return Returns loaded tree or NULL
+struct Bin_Tree *
+load_bin_tree(char *filename) {
+    int size = 0;
+    char *data = mmap_file(filename, &size);
+    if (!data) {
+        return NULL;
+    }
+    struct Bin_Tree *tree = (struct Bin_Tree *)calloc(1, sizeof(*tree));
+    if (!tree) {
+        fprintf(stderr, "Can not allocate memory\n");
+        munmap(data, size);
+        return NULL;
+    }
+    tree->data = data;
+    tree->size = size;
+    tree->header = (const struct Bin_Header *)data;
+    if ((uint64_t)size >= sizeof(struct Bin_Header)) {
+        tree->consts = (const double *)(data + tree->header->consts_offset);
+        tree->nodes = (const struct Bin_Node *)(data + tree->header->nodes_offset);
+        tree->name_offsets = (const uint32_t *)(data + tree->header->name_offsets_offset);
+        tree->names = data + tree->header->names_offset;
+    }
+    if (!check_bin_tree(tree)) {
+        unload_bin_tree(tree);
+        return NULL;
+    }
+    return tree;
+}
+
+//! \brief Unmap binary tree
+//! \param [in] tree Loaded tree
+void
+unload_bin_tree(struct Bin_Tree *tree) {
+    if (!tree) {
+        return;
+    }
+    munmap(tree->data, tree->size);
+    free(tree);
+}
+
+//! \brief Find child of the node
+//! \param [in] tree Loaded tree
+//! \param [in] node Node index
+//! \param [in] child_ind Child number
+//! \return Returns index of the child or -1
+int
+bin_child(struct Bin_Tree *tree, int node, int child_ind) {
+    if (child_ind < 0 || (uint32_t)child_ind >= tree->nodes[node].children_number) {
+        return -1;
+    }
+    int child = node + 1;
+    for (int i = 0; i < child_ind; i++) {
+        child += tree->nodes[child].subtree_size;
+    }
+    return child;
+}
+
+//! \brief Name of the node
+//! \param [in] tree Loaded tree
+//! \param [in] node Node index
+//! \return Returns name for VAR, FUNC_CALL, FUNC_DEF nodes, NULL for others
+const char *
+bin_name(struct Bin_Tree *tree, int node) {
+    if (!has_own_name(tree->nodes[node].operation)) {
+        return NULL;
+    }
+    return tree->names + tree->name_offsets[tree->nodes[node].operand];
+}
+
+//! \brief Value of CONSTANT node
+//! \param [in] tree Loaded tree
+//! \param [in] node Node index
+//! \return Returns value or NAN for non-constant nodes
+double
+bin_value(struct Bin_Tree *tree, int node) {
+    if (tree->nodes[node].operation != CONSTANT) {
+        return NAN;
+    }
+    return tree->consts[tree->nodes[node].operand];
+}
+
+//! \brief Calculate expression directly on the binary tree (as Node::get_val)
+//! \param [in] tree Loaded tree
+//! \param [in] node Node index
+//! \return Returns value (NAN, if there are vars)
+double
+bin_get_val(struct Bin_Tree *tree, int node) {
+    const struct Bin_Node *cur = &tree->nodes[node];
+    switch (cur->operation) {
+        case CONSTANT:
+            return tree->consts[cur->operand];
+        case LN:
+            return log(bin_get_val(tree, node + 1));
+        case SIN:
+            return sin(bin_get_val(tree, node + 1));
+        case COS:
+            return cos(bin_get_val(tree, node + 1));
+        case ADD:
+        case SUB:
+        case MUL:
+        case DIV:
+        case POWER:
+            break;
+        default:
+            fprintf(stderr, "Try to get val from non-constant expression\n");
+            return NAN;
+    }
+    int child = node + 1;
+    double res = bin_get_val(tree, child);
+    for (uint32_t i = 1; i < cur->children_number; i++) {
+        child += tree->nodes[child].subtree_size;
+        double operand = bin_get_val(tree, child);
+        switch (cur->operation) {
+            case ADD:
+                res += operand;
+                break;
+            case SUB:
+                res -= operand;
+                break;
+            case MUL:
+                res *= operand;
+                break;
+            case DIV:
+                res /= operand;
+                break;
+            default:
+                res = pow(res, operand);
+                break;
+        }
+    }
+    return res;
+}
+
+//! \brief Build Node tree from the binary one
+//! \param [in] tree Loaded tree
+//! \param [in] node Index of the subtree root (0 for the whole tree)
+//! \return Returns root of the new tree
+Node *
+bin_build_tree(struct Bin_Tree *tree, int node) {
+    const struct Bin_Node *cur = &tree->nodes[node];
+    Node *root = NULL;
+    if (cur->operation == CONSTANT) {
+        root = new Node(tree->consts[cur->operand]);
+    } else if (has_own_name(cur->operation)) {
+        root = new Node(cur->operation, (char *)bin_name(tree, node));
+    } else {
+        root = new Node(cur->operation);
+    }
+    int child = node + 1;
+    for (uint32_t i = 0; i < cur->children_number; i++) {
+        root->add_child(bin_build_tree(tree, child));
+        child += tree->nodes[child].subtree_size;
+    }
+    return root;
+}
@@ -0,0 +1,187 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <sys/mman.h>
+
+#include "tree.h"
+#include "columns.h"
+#include "in_and_out.h"
+#include "batch.h"
+#include "cse.h"
+#include "symbols.h"
+#include "stats.h"
+
+//! \brief Size of the part before columns: header and names
+//! \param [in] names Names of columns
+//! \param [in] columns_num Number of columns
+//! \param [in] rows Number of rows
+//! \param [out] data If not NULL, header and names are written here
+//! \return Returns offset of the first column
+long
+columns_layout(const char *const *names, int columns_num, long rows, char *data) {
+    long names_size = 0;
+    for (int i = 0; i < columns_num; i++) {
+        names_size += strlen(names[i]) + 1;
+    }
+    long data_offset = (sizeof(struct Col_Header) + names_size + 7) / 8 * 8;
+    if (!data) {
+        return data_offset;
+    }
+    memset(data, 0, data_offset);
+    struct Col_Header *header = (struct Col_Header *)data;
+    memcpy(header->magic, COL_MAGIC, sizeof(COL_MAGIC));
+    header->version = COL_VERSION;
+    header->columns_num = columns_num;
+    header->names_size = names_size;
+    header->rows = rows;
+    header->names_offset = sizeof(struct Col_Header);
+    header->data_offset = data_offset;
+    char *name = data + header->names_offset;
+    for (int i = 0; i < columns_num; i++) {
+        strcpy(name, names[i]);
+        name += strlen(names[i]) + 1;
+    }
+    return data_offset;
+}
+
+//! \brief Check header and find names and columns
+//! \return Returns true, if file is correct
+static bool
+check_columns(struct Col_File *file) {
+    const struct Col_Header *header = file->header;
+    uint64_t size = file->size;
+    if (size < sizeof(*header) || memcmp(header->magic, COL_MAGIC, sizeof(COL_MAGIC))) {
+        fprintf(stderr, "Not a columnar file\n");
+        return false;
+    }
+    if (header->version != COL_VERSION) {
+        fprintf(stderr, "Unsupported columnar file version %u\n", header->version);
+        return false;
+    }
+    if (header->data_offset % 8 || header->names_offset + header->names_size > header->data_offset ||
+        header->data_offset > size || !header->columns_num ||
+        header->rows > (size - header->data_offset) / sizeof(double) / header->columns_num) {
+        fprintf(stderr, "Broken columnar file: wrong sizes\n");
+        return false;
+    }
+    file->names = (const char **)calloc(header->columns_num, sizeof(*file->names));
+    file->columns = (const double **)calloc(header->columns_num, sizeof(*file->columns));
+    if (!file->names || !file->columns) {
+        fprintf(stderr, "Can not allocate memory\n");
+        return false;
+    }
+    const char *name = file->data + header->names_offset;
+    const char *names_end = name + header->names_size;
+    const double *column = (const double *)(file->data + header->data_offset);
+    for (uint32_t i = 0; i < header->columns_num; i++) {
+        const char *name_end = (const char *)memchr(name, '\0', names_end - name);
+        if (!name_end) {
+            fprintf(stderr, "Broken columnar file: wrong names\n");
+            return false;
+        }
+        file->names[i] = name;
+        file->columns[i] = column;
+        name = name_end + 1;
+        column += header->rows;
+    }
+    return true;
+}
+
+//! \brief Mmap columnar file
+//! \param [in] filename File name
+//! \return Returns loaded file or NULL
+struct Col_File *
+load_columns(char *filename) {
+    long size = 0;
+    char *data = mmap_file(filename, &size, true);
+    if (!data) {
+        return NULL;
+    }
+    struct Col_File *file = (struct Col_File *)calloc(1, sizeof(*file));
+    if (!file) {
+        fprintf(stderr, "Can not allocate memory\n");
+        munmap(data, size);
+        return NULL;
+    }
+    file->data = data;
+    file->size = size;
+    file->header = (const struct Col_Header *)data;
+    if (!check_columns(file)) {
+        unload_columns(file);
+        return NULL;
+    }
+    return file;
+}
+
+//! \brief Unmap columnar file
+void
+unload_columns(struct Col_File *file) {
+    if (!file) {
+        return;
+    }
+    munmap(file->data, file->size);
+    free(file->names);
+    free(file->columns);
+    free(file);
+}
+
+//! \brief Calculate expression in every row of columnar file, variables are
+//! columns with the same names. Rows are streamed by windows: pages of the
+//! window are read sequentially, calculated by batch_eval and released, so
+//! files bigger than memory are calculated without parsing of values
+//! \param [in] dag Expression
+//! \param [in] in_file Columnar file with values of variables
+//! \param [in] out_file Columnar file with one column of results
+//! \param [in] out_name Name of the result column
+//! \param [in] threads Number of threads
+//! \return Returns 0 in success -1 else
+int
+columns_eval(struct Cse_Dag *dag, char *in_file, char *out_file, const char *out_name, int threads) {
+    long long start_time = stats_begin(PHASE_EVAL);
+    struct Col_File *in = load_columns(in_file);
+    if (!in) {
+        stats_add_time(PHASE_EVAL, start_time);
+        return -1;
+    }
+    long rows = in->header->rows;
+    int columns_num = in->header->columns_num;
+    std::vector<int> ids(columns_num);
+    for (int i = 0; i < columns_num; i++) {
+        ids[i] = intern_symbol(in->names[i]);
+    }
+    long data_offset = columns_layout(&out_name, 1, rows, NULL);
+    long out_size = data_offset + rows * (long)sizeof(double);
+    char *out = mmap_out_file(out_file, out_size);
+    if (!out) {
+        unload_columns(in);
+        stats_add_time(PHASE_EVAL, start_time);
+        return -1;
+    }
+    columns_layout(&out_name, 1, rows, out);
+    double *res = (double *)(out + data_offset);
+
+    std::vector<const double *> window(symbols_number(), NULL);
+    int err = 0;
+    for (long start = 0; start < rows && !err; start += COL_WINDOW_ROWS) {
+        long count = std::min(COL_WINDOW_ROWS, rows - start);
+        for (int i = 0; i < columns_num; i++) {
+            window[ids[i]] = in->columns[i] + start;
+        }
+        err = batch_eval(dag, window.data(), window.size(), count, res + start, threads);
+        for (int i = 0; i < columns_num; i++) {
+            long begin = (const char *)(in->columns[i] + start) - in->data;
+            release_pages(in->data, begin, begin + count * sizeof(double));
+        }
+        long begin = (char *)(res + start) - out;
+        release_pages(out, begin, begin + count * sizeof(double));
+    }
+    if (munmap(out, out_size)) {
+        fprintf(stderr, "Can not write %s\n", out_file);
+        err = -1;
+    }
+    unload_columns(in);
+    stats_add_time(PHASE_EVAL, start_time);
+    return err ? -1 : 0;
+}
@@ -0,0 +1,375 @@
+#include <cstdio>
+#include <cmath>
+#include <cstring>
+#include <cassert>
+#include <vector>
+#include <unordered_map>
+
+#include "tree.h"
+#include "cse.h"
+#include "stats.h"
+#include "symbols.h"
+
+//! \brief One distinct subtree: operands are indexes of earlier nodes
+struct Cse_Node {
+    int operation;
+    double value;
+    int name_id;
+    std::vector<int> operands;
+    int uses;
+};
+
+struct Cse_Node_Hash {
+    size_t operator()(const struct Cse_Node &node) const {
+        size_t hash = node.operation * 1000003ULL ^ node.name_id;
+        if (node.operation == CONSTANT) {
+            long long bits = 0;
+            memcpy(&bits, &node.value, sizeof(bits));
+            hash = hash * 1000003ULL ^ bits;
+        }
+        for (size_t i = 0; i < node.operands.size(); i++) {
+            hash = hash * 1000003ULL ^ node.operands[i];
+        }
+        return hash;
+    }
+};
+
+struct Cse_Node_Eq {
+    bool operator()(const struct Cse_Node &first, const struct Cse_Node &second) const {
+        return first.operation == second.operation && first.name_id == second.name_id &&
+               (first.operation != CONSTANT || first.value == second.value) &&
+               first.operands == second.operands;
+    }
+};
+
+//! \brief Expression as DAG: equal subtrees are stored once (hash consing),
+//! nodes are in topological order, the root is the last one
+struct Cse_Dag {
+    std::vector<struct Cse_Node> nodes;
+    std::unordered_map<struct Cse_Node, int, Cse_Node_Hash, Cse_Node_Eq> ids;
+    std::vector<double> temps;  // value of every node during evaluation
+};
+
+//! \brief Add subtree into DAG, equal subtrees get the same index, as
+//! operands of equal subtrees are already the same indexes. Uses of a node
+//! are references from other DAG nodes, counted, when the user is created
+//! \return Returns index of the subtree
+static int
+add_subtree(struct Cse_Dag *dag, Node *node) {
+    struct Cse_Node key;
+    key.operation = node->get_operation();
+    key.value = (key.operation == CONSTANT) ? node->get_value() : 0;
+    key.name_id = node->get_name_id();
+    key.uses = 0;
+    key.operands.reserve(node->get_children_number());
+    for (int i = 0; i < node->get_children_number(); i++) {
+        key.operands.push_back(add_subtree(dag, node->get_childs()[i]));
+    }
+    auto found = dag->ids.find(key);
+    if (found != dag->ids.end()) {
+        return found->second; // its user is the same existing node or is counted, when created
+    }
+    for (size_t i = 0; i < key.operands.size(); i++) {
+        struct Cse_Node *operand = &dag->nodes[key.operands[i]];
+        operand->uses++;
+        if (operand->uses == 2 && !operand->operands.empty()) {
+            STAT_INC(CSE_SHARED);
+        }
+    }
+    int id = dag->nodes.size();
+    dag->nodes.push_back(key);
+    dag->ids.emplace(key, id);
+    return id;
+}
+
+//! \brief Eliminate common subexpressions: build DAG, where structurally
+//! equal subtrees are shared temporaries
+//! \param [in] root Expression
+//! \return Returns DAG or NULL
+struct Cse_Dag *
+cse_build(Node *root) {
+    if (!root) {
+        return NULL;
+    }
+    root->expand_lazy(); // once, in place: the tree keeps the expansion
+    struct Cse_Dag *dag = new Cse_Dag;
+    dag->nodes[add_subtree(dag, root)].uses = 1; // used by the result
+    dag->temps.resize(dag->nodes.size());
+    return dag;
+}
+
+//! \brief Free DAG
+void
+cse_free(struct Cse_Dag *dag) {
+    delete dag;
+}
+
+//! \brief Number of distinct subtrees
+int
+cse_nodes_number(struct Cse_Dag *dag) {
+    return dag ? dag->nodes.size() : 0;
+}
+
+//! \brief Number of shared temporaries: operations used more than once
+int
+cse_shared_number(struct Cse_Dag *dag) {
+    int res = 0;
+    for (size_t i = 0; dag && i < dag->nodes.size(); i++) {
+        if (dag->nodes[i].uses > 1 && !dag->nodes[i].operands.empty()) {
+            res++;
+        }
+    }
+    return res;
+}
+
+//! \brief Calculate value of expression, every shared subtree is calculated once
+//! \param [in] dag Expression
+//! \param [in] values Values of variables by symbol id, may be NULL
+//! \param [in] values_num Size of values
+//! \return Returns value (NAN, if some variable has no value)
+double
+cse_eval(struct Cse_Dag *dag, const double *values, int values_num) {
+    assert(dag);
+    return cse_eval_temps(dag, values, values_num, dag->temps.data());
+}
+
+//! \brief The same as cse_eval, but with caller's scratch memory,
+//! so one DAG can be evaluated by several threads at once
+//! \param [in] temps Array of cse_nodes_number(dag) values
+double
+cse_eval_temps(struct Cse_Dag *dag, const double *values, int values_num, double *temps) {
+    assert(dag);
+    assert(temps);
+    for (size_t i = 0; i < dag->nodes.size(); i++) {
+        struct Cse_Node *node = &dag->nodes[i];
+        const int *operands = node->operands.data();
+        double res = 0;
+        switch (node->operation) {
+            case CONSTANT:
+                res = node->value;
+                break;
+            case VAR:
+                if (node->name_id >= values_num || !values) {
+                    fprintf(stderr, "Variable %s has no value\n", symbol_name(node->name_id));
+                    return NAN;
+                }
+                res = values[node->name_id];
+                break;
+            case LN:
+                res = log(temps[operands[0]]);
+                break;
+            case SIN:
+                res = sin(temps[operands[0]]);
+                break;
+            case COS:
+                res = cos(temps[operands[0]]);
+                break;
+            default: // the same left fold as in get_val
+                res = temps[operands[0]];
+                for (size_t j = 1; j < node->operands.size(); j++) {
+                    double operand = temps[operands[j]];
+                    switch (node->operation) {
+                        case ADD:
+                            res += operand;
+                            break;
+                        case SUB:
+                            res -= operand;
+                            break;
+                        case MUL:
+                            res *= operand;
+                            break;
+                        case DIV:
+                            res /= operand;
+                            break;
+                        case POWER:
+                            res = pow(res, operand);
+                            break;
+                        default:
+                            fprintf(stderr, "Can not calculate operation %s\n", symbol_name(node->operation));
+                            return NAN;
+                    }
+                }
+                break;
+        }
+        temps[i] = res;
+    }
+    return temps[dag->nodes.size() - 1];
+}
+
+//! \brief Calculate expression in count points at once: every DAG node is
+//! calculated for all points before the next one, so inner loops are simple
+//! loops over arrays, which the compiler vectorizes
+//! \param [in] columns Values of variables by symbol id, column[first + i] is
+//! the value in point i, NULL for unbound variable
+//! \param [in] columns_num Size of columns
+//! \param [in] first Index of the first point in columns
+//! \param [in] count Number of points
+//! \param [in] temps Scratch memory of cse_nodes_number(dag) * count values
+//! \param [out] res Values in count points
+//! \return Returns 0 in success -1 else
+int
+cse_eval_columns(struct Cse_Dag *dag, const double *const *columns, int columns_num,
+                 long first, int count, double *temps, double *res) {
+    assert(dag);
+    assert(temps);
+    assert(res);
+    std::vector<const double *> rows(dag->nodes.size());
+    for (size_t i = 0; i < dag->nodes.size(); i++) {
+        struct Cse_Node *node = &dag->nodes[i];
+        double *row = temps + i * count;
+        rows[i] = row;
+        switch (node->operation) {
+            case CONSTANT:
+                for (int k = 0; k < count; k++) {
+                    row[k] = node->value;
+                }
+                continue;
+            case VAR: // the column is used in place
+                if (node->name_id >= columns_num || !columns || !columns[node->name_id]) {
+                    fprintf(stderr, "Variable %s has no value\n", symbol_name(node->name_id));
+                    return -1;
+                }
+                rows[i] = columns[node->name_id] + first;
+                continue;
+            case LN:
+            case SIN:
+            case COS:
+            case ADD:
+            case SUB:
+            case MUL:
+            case DIV:
+            case POWER:
+                break;
+            default:
+                fprintf(stderr, "Can not calculate operation %s\n", symbol_name(node->operation));
+                return -1;
+        }
+        const double *operand = rows[node->operands[0]];
+        switch (node->operation) {
+            case LN:
+                for (int k = 0; k < count; k++) {
+                    row[k] = log(operand[k]);
+                }
+                continue;
+            case SIN:
+                for (int k = 0; k < count; k++) {
+                    row[k] = sin(operand[k]);
+                }
+                continue;
+            case COS:
+                for (int k = 0; k < count; k++) {
+                    row[k] = cos(operand[k]);
+                }
+                continue;
+            default: // the same left fold as in get_val
+                memcpy(row, operand, count * sizeof(*row));
+                break;
+        }
+        for (size_t j = 1; j < node->operands.size(); j++) {
+            operand = rows[node->operands[j]];
+            switch (node->operation) {
+                case ADD:
+                    for (int k = 0; k < count; k++) {
+                        row[k] += operand[k];
+                    }
+                    break;
+                case SUB:
+                    for (int k = 0; k < count; k++) {
+                        row[k] -= operand[k];
+                    }
+                    break;
+                case MUL:
+                    for (int k = 0; k < count; k++) {
+                        row[k] *= operand[k];
+                    }
+                    break;
+                case DIV:
+                    for (int k = 0; k < count; k++) {
+                        row[k] /= operand[k];
+                    }
+                    break;
+                default: // POWER
+                    for (int k = 0; k < count; k++) {
+                        row[k] = pow(row[k], operand[k]);
+                    }
+                    break;
+            }
+        }
+    }
+    memcpy(res, rows[dag->nodes.size() - 1], count * sizeof(*res));
+    return 0;
+}
+
+//! \brief Fill color of the node, as in Node::visualize_tree_rec
+static const char *
+node_color(int operation) {
+    switch (operation) {
+        case VAR:
+            return "\"green\"";
+        case FUNC_CALL:
+            return "\"blue\"";
+        case FUNC_DEF:
+            return "\"pink\"";
+        case RETURN:
+            return "\"red\"";
+        case FOR:
+        case WHILE:
+        case IF:
+            return "\"lightgrey\"";
+        default:
+            return "\"darkgrey\"";
+    }
+}
+
+//! \brief Write description of one DAG node in dot format, shared node has double border
+//! \param [in] fd File descriptor
+//! \param [in] node DAG node
+//! \param [in] id Dot id of the node
+static void
+export_dot_node(int fd, struct Cse_Node *node, int id) {
+    if (node->operation == CONSTANT) {
+        dprintf(fd, "%d [style = filled, label=\"%lf\", fillcolor=\"yellow\"];\n", id, node->value);
+        return;
+    }
+    dprintf(fd, "%d [style = filled, label=\"%s\", shape = box, fillcolor=%s%s];\n", id,
+            symbol_name(node->name_id), node_color(node->operation),
+            node->uses > 1 && !node->operands.empty() ? ", peripheries=2" : "");
+}
+
+//! \brief Writes DAG in dot-readable format: shared subtree is drawn once
+//! with several incoming edges, leaves are drawn for every use
+//! \param [in] dag Expression
+//! \param [in] fd File descriptor
+//! \param [in] graph_name Name of the graph or NULL
+//! \return Returns 0 in success, -1 else
+int
+cse_export_dot(struct Cse_Dag *dag, int fd, char *graph_name) {
+    assert(fd >= 0);
+    if (!dag || dag->nodes.empty()) {
+        return -1;
+    }
+    dprintf(fd, "digraph %s {\n", graph_name ? graph_name : "G");
+    int leaf_id = dag->nodes.size();
+    bool constant = true;
+    for (size_t i = 0; i < dag->nodes.size(); i++) {
+        struct Cse_Node *node = &dag->nodes[i];
+        constant = constant && node->operation != VAR;
+        if (!node->operands.empty() || i + 1 == dag->nodes.size()) {
+            export_dot_node(fd, node, i);
+        }
+        for (size_t j = 0; j < node->operands.size(); j++) {
+            struct Cse_Node *operand = &dag->nodes[node->operands[j]];
+            if (operand->operands.empty()) {
+                export_dot_node(fd, operand, leaf_id);
+                dprintf(fd, "%zu->%d;\n", i, leaf_id++);
+            } else {
+                dprintf(fd, "%zu->%d;\n", i, node->operands[j]);
+            }
+        }
+    }
+    if (constant) {
+        dprintf(fd, "\"result=%lf\" [shape=box];", cse_eval(dag, NULL, 0));
+    }
+    dprintf(fd, "\n}\n");
+    return 0;
+}
@@ -0,0 +1,194 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "disk_cache.h"
+#include "stats.h"
+
+//! \brief Create directory with all parents
+//! \return Returns 0 in success -1 else
+static int
+make_dirs(const char *path) {
+    std::string part(path);
+    for (size_t i = 1; i <= part.size(); i++) {
+        if (i == part.size() || part[i] == '/') {
+            std::string dir = part.substr(0, i);
+            if (mkdir(dir.c_str(), S_IRWXU) && errno != EEXIST) {
+                fprintf(stderr, "Can not create directory %s\n", dir.c_str());
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+//! \brief Find and create directory of a cache
+//! \param [in] dir Directory, NULL for default_name in $XDG_CACHE_HOME or ~/.cache
+//! \param [in] default_name Name of the default directory
+//! \return Returns allocated path or NULL
+char *
+disk_cache_dir(const char *dir, const char *default_name) {
+    std::string path;
+    if (dir) {
+        path = dir;
+    } else if (getenv("XDG_CACHE_HOME")) {
+        path = std::string(getenv("XDG_CACHE_HOME")) + "/" + default_name;
+    } else if (getenv("HOME")) {
+        path = std::string(getenv("HOME")) + "/.cache/" + default_name;
+    } else {
+        fprintf(stderr, "Can not find directory for %s: HOME is not set\n", default_name);
+        return NULL;
+    }
+    if (make_dirs(path.c_str())) {
+        return NULL;
+    }
+    char *res = strdup(path.c_str());
+    if (!res) {
+        fprintf(stderr, "Can not allocate memory\n");
+    }
+    return res;
+}
+
+//! \brief File of the cache directory
+struct Cache_File {
+    std::string name;
+    long size;
+    long long mtime_ns;
+};
+
+//! \brief Remove the least recently used files, while the cache is bigger,
+//! than its limit
+//! \param [in] dir Directory of the cache
+//! \param [in] max_bytes Size of the cache
+//! \param [in] evicted_counter Counter from Stat_Counters for removed files
+void
+disk_cache_evict(const char *dir, long max_bytes, int evicted_counter) {
+    DIR *cache_dir = opendir(dir);
+    if (!cache_dir) {
+        return;
+    }
+    std::vector<struct Cache_File> files;
+    long total = 0;
+    for (struct dirent *entry = readdir(cache_dir); entry; entry = readdir(cache_dir)) {
+        std::string name = std::string(dir) + "/" + entry->d_name;
+        struct stat st;
+        if (entry->d_name[0] == '.' || stat(name.c_str(), &st) || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        files.push_back({name, (long)st.st_size, st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec});
+        total += st.st_size;
+    }
+    closedir(cache_dir);
+    if (total <= max_bytes) {
+        return;
+    }
+    std::sort(files.begin(), files.end(), [](const struct Cache_File &first, const struct Cache_File &second) {
+        return first.mtime_ns < second.mtime_ns;
+    });
+    for (size_t i = 0; i < files.size() && total > max_bytes; i++) {
+        if (!unlink(files[i].name.c_str())) {
+            total -= files[i].size;
+            STAT_INC(evicted_counter);
+        }
+    }
+}
+
+//! \brief Identity of program file: a new version of it is another file
+//! \param [in] path Path of the program
+//! \return Returns allocated "path:size:mtime" or NULL, if there is no such file
+char *
+disk_cache_identity(const char *path) {
+    struct stat st;
+    if (stat(path, &st) || !S_ISREG(st.st_mode)) {
+        return NULL;
+    }
+    char buf[64];
+    snprintf(buf, sizeof(buf), ":%ld:%lld", (long)st.st_size, st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec);
+    return strdup((std::string(path) + buf).c_str());
+}
+
+//! \brief FNV-1a and its variant with other seed and multiplier, 128 bits together
+static void
+hash_bytes(const char *data, long size, unsigned long long *first, unsigned long long *second) {
+    for (long i = 0; i < size; i++) {
+        unsigned char byte = data[i];
+        *first = (*first ^ byte) * 1099511628211ULL;
+        *second = (*second ^ byte) * 0xff51afd7ed558ccdULL;
+    }
+}
+
+//! \brief Final mix, so every byte of source changes all bits of the name
+static unsigned long long
+hash_finish(unsigned long long hash) {
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+//! \brief Name of cached file for the source text
+//! \param [in] dir Directory of the cache
+//! \param [in] keys Strings, which change the cached file (versions, options)
+//! \param [in] keys_num Number of keys
+//! \param [in] text Source
+//! \param [in] size Size of text
+//! \param [in] extension Extension of the file (".png")
+//! \return Returns allocated file name or NULL
+char *
+disk_cache_entry(const char *dir, const char *const *keys, int keys_num,
+                 const char *text, long size, const char *extension) {
+    unsigned long long first = 14695981039346656037ULL;
+    unsigned long long second = 0x6c62272e07bb0142ULL;
+    for (int i = 0; i < keys_num; i++) {
+        hash_bytes(keys[i], strlen(keys[i]) + 1, &first, &second);
+    }
+    hash_bytes(text, size, &first, &second);
+    int name_size = strlen(dir) + strlen(extension) + 2 * 16 + 2;
+    char *entry = (char *)calloc(name_size, sizeof(char));
+    if (!entry) {
+        fprintf(stderr, "Can not allocate memory\n");
+        return NULL;
+    }
+    snprintf(entry, name_size, "%s/%016llx%016llx%s", dir, hash_finish(first), hash_finish(second), extension);
+    return entry;
+}
+
+//! \brief Copy file contents
+//! \param [in] from Source file
+//! \param [in] to Created file
+//! \param [in] mode Permissions of the created file
+//! \return Returns 0 in success -1 else
+int
+disk_cache_copy(const char *from, const char *to, int mode) {
+    int in = open(from, O_RDONLY);
+    if (in < 0) {
+        return -1;
+    }
+    int out = open(to, O_WRONLY | O_CREAT | O_TRUNC, mode);
+    if (out < 0) {
+        close(in);
+        return -1;
+    }
+    char buf[DISK_CACHE_COPY_BLOCK];
+    long res = 0;
+    while ((res = read(in, buf, sizeof(buf))) > 0) {
+        if (write(out, buf, res) != res) {
+            res = -1;
+            break;
+        }
+    }
+    close(in);
+    if (close(out) || res < 0) {
+        unlink(to);
+        return -1;
+    }
+    return 0;
+}
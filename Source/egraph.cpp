@@ -0,0 +1,514 @@
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <unordered_map>
+
+#include "tree.h"
+#include "egraph.h"
+#include "rewrite.h"
+#include "stats.h"
+#include "symbols.h"
+
+//! \brief Identities, which are unsafe for the greedy simplifier (they can loop),
+//! but are fine in e-graph, where nothing is ever removed
+static const char *egraph_rules_text[][2] = {
+    {"((x) + (y))", "((y) + (x))"},
+    {"((x) * (y))", "((y) * (x))"},
+    {"(((x) + (y)) + (z))", "((x) + ((y) + (z)))"},
+    {"((x) + ((y) + (z)))", "(((x) + (y)) + (z))"},
+    {"(((x) * (y)) * (z))", "((x) * ((y) * (z)))"},
+    {"((x) * ((y) * (z)))", "(((x) * (y)) * (z))"},
+    {"((x) + (0))", "(x)"},
+    {"((x) - (0))", "(x)"},
+    {"((x) * (1))", "(x)"},
+    {"((x) + (x))", "((2) * (x))"},
+    {"((x) * (x))", "((x) ^ (2))"},
+    {"(((x) * (y)) + ((x) * (z)))", "((x) * ((y) + (z)))"},
+    {"(((x) * (y)) - ((x) * (z)))", "((x) * ((y) - (z)))"},
+    {"((x) + ((x) * (y)))", "((x) * ((y) + (1)))"},
+    {"((x) - ((x) * (y)))", "((x) * ((1) - (y)))"},
+    {"(((y) * (x)) / ((x) ^ (z)))", "((y) / ((x) ^ ((z) - (1))))"},
+    {"(((x) ^ (y)) / (x))", "((x) ^ ((y) - (1)))"},
+    {"(((x) + (y)) - (x))", "(y)"},
+    {"(((x) - (y)) - (z))", "((x) - ((y) + (z)))"},
+    {"(((x) / (y)) / (z))", "((x) / ((y) * (z)))"},
+    {"(((x) / (y)) * (y))", "(x)"},
+};
+
+//! \brief Operation with e-classes as operands
+struct E_Node {
+    int operation;
+    double value;              // for CONSTANT
+    int name;                  // symbol id of the var name for VAR, SYMBOL_NONE else
+    std::vector<int> children; // e-classes
+    bool operator==(const E_Node &other) const {
+        return operation == other.operation && name == other.name &&
+               !memcmp(&value, &other.value, sizeof(value)) && children == other.children;
+    }
+};
+
+struct E_Node_Hash {
+    size_t operator()(const E_Node &node) const {
+        unsigned long long bits = 0;
+        memcpy(&bits, &node.value, sizeof(bits));
+        size_t hash = node.operation * 1000003ULL ^ node.name ^ (bits * 0x9E3779B97F4A7C15ULL);
+        for (size_t i = 0; i < node.children.size(); i++) {
+            hash = hash * 1000003ULL ^ node.children[i];
+        }
+        return hash;
+    }
+};
+
+//! \brief Set of e-classes, each is a set of equivalent e-nodes
+struct E_Graph {
+    std::vector<E_Node> nodes;
+    std::vector<int> node_class;              // e-class of e-node (canonical after rebuild)
+    std::vector<int> parent;                  // union-find of e-classes
+    std::vector<std::vector<int>> class_nodes;
+    std::vector<char> has_const;              // constant analysis: value of the class is known
+    std::vector<double> const_value;
+    std::unordered_map<E_Node, int, E_Node_Hash> memo; // e-node -> e-node index, for hash-consing
+    long unions;
+    bool dirty;
+};
+
+typedef std::vector<std::pair<int, int>> Subst; // wildcard symbol id -> e-class
+
+static int
+find(struct E_Graph *graph, int cls) {
+    while (graph->parent[cls] != cls) {
+        graph->parent[cls] = graph->parent[graph->parent[cls]];
+        cls = graph->parent[cls];
+    }
+    return cls;
+}
+
+static void
+canonicalize(struct E_Graph *graph, E_Node *node) {
+    for (size_t i = 0; i < node->children.size(); i++) {
+        node->children[i] = find(graph, node->children[i]);
+    }
+}
+
+//! \brief Calculate e-node, if values of all operands are known
+//! \param [in] graph E-graph
+//! \param [in] node E-node
+//! \param [out] res Value
+//! \return Returns true, if value is known and finite
+static bool
+fold(struct E_Graph *graph, E_Node *node, double *res) {
+    double args[2] = {};
+    if (node->operation == CONSTANT || node->operation == VAR || node->children.size() > 2) {
+        return false;
+    }
+    for (size_t i = 0; i < node->children.size(); i++) {
+        int cls = find(graph, node->children[i]);
+        if (!graph->has_const[cls]) {
+            return false;
+        }
+        args[i] = graph->const_value[cls];
+    }
+    switch (node->operation) {
+        case ADD:
+            *res = args[0] + args[1];
+            break;
+        case SUB:
+            *res = args[0] - args[1];
+            break;
+        case MUL:
+            *res = args[0] * args[1];
+            break;
+        case DIV:
+            *res = args[0] / args[1];
+            break;
+        case POWER:
+            *res = pow(args[0], args[1]);
+            break;
+        case LN:
+            *res = log(args[0]);
+            break;
+        case SIN:
+            *res = sin(args[0]);
+            break;
+        case COS:
+            *res = cos(args[0]);
+            break;
+        default:
+            return false;
+    }
+    return std::isfinite(*res);
+}
+
+static int merge(struct E_Graph *graph, int cls1, int cls2);
+
+//! \brief Add e-node, if there is no the same one
+//! \param [in] graph E-graph
+//! \param [in] node E-node
+//! \return Returns e-class of the e-node
+static int
+add(struct E_Graph *graph, E_Node node) {
+    canonicalize(graph, &node);
+    auto found = graph->memo.find(node);
+    if (found != graph->memo.end()) {
+        return find(graph, graph->node_class[found->second]);
+    }
+    int ind = graph->nodes.size();
+    int cls = graph->parent.size();
+    graph->nodes.push_back(node);
+    graph->node_class.push_back(cls);
+    graph->parent.push_back(cls);
+    graph->class_nodes.push_back(std::vector<int>(1, ind));
+    graph->has_const.push_back(node.operation == CONSTANT);
+    graph->const_value.push_back(node.value);
+    graph->memo.emplace(node, ind);
+    STAT_INC(EGRAPH_NODES);
+
+    double value = 0;
+    if (fold(graph, &node, &value)) {
+        graph->has_const[cls] = true;
+        graph->const_value[cls] = value;
+        E_Node constant = {CONSTANT, value, SYMBOL_NONE, {}};
+        cls = merge(graph, cls, add(graph, constant));
+    }
+    return cls;
+}
+
+//! \brief Union two e-classes. Congruence is restored later by rebuild
+//! \return Returns e-class of the union
+static int
+merge(struct E_Graph *graph, int cls1, int cls2) {
+    cls1 = find(graph, cls1);
+    cls2 = find(graph, cls2);
+    if (cls1 == cls2) {
+        return cls1;
+    }
+    if (graph->class_nodes[cls1].size() < graph->class_nodes[cls2].size()) {
+        std::swap(cls1, cls2);
+    }
+    graph->parent[cls2] = cls1;
+    graph->class_nodes[cls1].insert(graph->class_nodes[cls1].end(),
+                                    graph->class_nodes[cls2].begin(), graph->class_nodes[cls2].end());
+    std::vector<int>().swap(graph->class_nodes[cls2]);
+    if (!graph->has_const[cls1] && graph->has_const[cls2]) {
+        graph->has_const[cls1] = true;
+        graph->const_value[cls1] = graph->const_value[cls2];
+    }
+    graph->unions++;
+    graph->dirty = true;
+    return cls1;
+}
+
+//! \brief Restore hash-consing and congruence after unions: equal e-nodes
+//! must be in the same e-class
+static void
+rebuild(struct E_Graph *graph) {
+    while (graph->dirty) {
+        graph->dirty = false;
+        graph->memo.clear();
+        std::vector<std::pair<int, double>> consts;
+        int classes = graph->parent.size();
+        for (int cls = 0; cls < classes; cls++) {
+            if (find(graph, cls) != cls) {
+                continue;
+            }
+            std::vector<int> list;
+            list.swap(graph->class_nodes[cls]);
+            for (size_t i = 0; i < list.size(); i++) {
+                int ind = list[i];
+                int cur = find(graph, cls);
+                canonicalize(graph, &graph->nodes[ind]);
+                auto found = graph->memo.find(graph->nodes[ind]);
+                if (found != graph->memo.end() && find(graph, graph->node_class[found->second]) == cur) {
+                    continue; // duplicate in the same e-class
+                }
+                graph->class_nodes[cur].push_back(ind);
+                graph->node_class[ind] = cur;
+                if (found != graph->memo.end()) {
+                    merge(graph, cur, graph->node_class[found->second]);
+                    continue;
+                }
+                graph->memo.emplace(graph->nodes[ind], ind);
+                double value = 0;
+                if (!graph->has_const[cur] && fold(graph, &graph->nodes[ind], &value)) {
+                    consts.push_back(std::make_pair(cur, value));
+                }
+            }
+        }
+        for (size_t i = 0; i < consts.size(); i++) {
+            int cls = find(graph, consts[i].first);
+            if (!graph->has_const[cls]) {
+                graph->has_const[cls] = true;
+                graph->const_value[cls] = consts[i].second;
+                E_Node constant = {CONSTANT, consts[i].second, SYMBOL_NONE, {}};
+                merge(graph, cls, add(graph, constant));
+            }
+        }
+    }
+}
+
+//! \brief Add tree to e-graph. N-ary operations become left-folded binary ones,
+//! as they are calculated by get_val
+//! \return Returns e-class of the root or -1, if tree is not an expression
+static int
+add_tree(struct E_Graph *graph, Node *root) {
+    E_Node node = {root->get_operation(), 0, SYMBOL_NONE, {}};
+    switch (root->get_operation()) {
+        case CONSTANT:
+            node.value = root->get_value();
+            return add(graph, node);
+        case VAR:
+            node.name = root->get_name_id();
+            return add(graph, node);
+        case LN:
+        case SIN:
+        case COS: {
+            int child = add_tree(graph, root->get_childs()[0]);
+            if (child < 0) {
+                return -1;
+            }
+            node.children.push_back(child);
+            return add(graph, node);
+        }
+        case ADD:
+        case SUB:
+        case MUL:
+        case DIV:
+        case POWER: {
+            int cur = add_tree(graph, root->get_childs()[0]);
+            for (int i = 1; i < root->get_children_number() && cur >= 0; i++) {
+                int child = add_tree(graph, root->get_childs()[i]);
+                if (child < 0) {
+                    return -1;
+                }
+                node.children.assign(1, cur);
+                node.children.push_back(child);
+                cur = add(graph, node);
+            }
+            return cur;
+        }
+        default:
+            return -1;
+    }
+}
+
+//! \brief Find all substitutions, which make patterns equal to their e-classes
+//! \param [in] graph E-graph
+//! \param [in,out] todo Pairs of pattern and e-class left to match
+//! \param [in,out] subst Wildcards bound so far
+//! \param [out] res Found substitutions
+static void
+ematch(struct E_Graph *graph, std::vector<std::pair<Node *, int>> &todo, Subst &subst, std::vector<Subst> &res) {
+    if (todo.empty()) {
+        res.push_back(subst);
+        return;
+    }
+    std::pair<Node *, int> cur = todo.back();
+    todo.pop_back();
+    Node *pattern = cur.first;
+    int cls = find(graph, cur.second);
+    if (pattern->get_operation() == VAR) {
+        size_t i = 0;
+        for (; i < subst.size() && subst[i].first != pattern->get_name_id(); i++);
+        if (i == subst.size()) {
+            subst.push_back(std::make_pair(pattern->get_name_id(), cls));
+            ematch(graph, todo, subst, res);
+            subst.pop_back();
+        } else if (find(graph, subst[i].second) == cls) {
+            ematch(graph, todo, subst, res);
+        }
+    } else if (pattern->get_operation() == CONSTANT) {
+        if (graph->has_const[cls] && is_eq(graph->const_value[cls], pattern->get_value())) {
+            ematch(graph, todo, subst, res);
+        }
+    } else {
+        size_t arity = pattern->get_children_number();
+        std::vector<int> &list = graph->class_nodes[cls];
+        for (size_t i = 0; i < list.size(); i++) {
+            E_Node &node = graph->nodes[list[i]];
+            if (node.operation != pattern->get_operation() || node.children.size() != arity) {
+                continue;
+            }
+            for (int j = arity - 1; j >= 0; j--) {
+                todo.push_back(std::make_pair(pattern->get_childs()[j], node.children[j]));
+            }
+            ematch(graph, todo, subst, res);
+            todo.resize(todo.size() - arity);
+        }
+    }
+    todo.push_back(cur);
+}
+
+//! \brief Add replacement with substituted wildcards to e-graph
+//! \return Returns e-class of the replacement
+static int
+instantiate(struct E_Graph *graph, Node *pattern, Subst &subst) {
+    E_Node node = {pattern->get_operation(), 0, SYMBOL_NONE, {}};
+    if (pattern->get_operation() == VAR) {
+        for (size_t i = 0; i < subst.size(); i++) {
+            if (subst[i].first == pattern->get_name_id()) {
+                return subst[i].second;
+            }
+        }
+        return add_tree(graph, pattern);
+    }
+    if (pattern->get_operation() == CONSTANT) {
+        node.value = pattern->get_value();
+        return add(graph, node);
+    }
+    for (int i = 0; i < pattern->get_children_number(); i++) {
+        node.children.push_back(instantiate(graph, pattern->get_childs()[i], subst));
+    }
+    return add(graph, node);
+}
+
+//! \brief Apply all rules to all e-classes once
+//! \param [in] graph E-graph
+//! \param [in] rules Rule sets
+//! \param [in] max_nodes Limit of e-nodes
+static void
+apply_rules(struct E_Graph *graph, struct Rule_Set **rules, int sets_num, long max_nodes) {
+    int classes = graph->parent.size();
+    for (int set = 0; set < sets_num; set++) {
+        for (int rule = 0; rule < rules_number(rules[set]); rule++) {
+            Node *lhs = rule_pattern(rules[set], rule);
+            Node *rhs = rule_replacement(rules[set], rule);
+            for (int cls = 0; cls < classes; cls++) {
+                if (find(graph, cls) != cls) {
+                    continue;
+                }
+                std::vector<std::pair<Node *, int>> todo(1, std::make_pair(lhs, cls));
+                Subst subst;
+                std::vector<Subst> matches;
+                ematch(graph, todo, subst, matches);
+                for (size_t i = 0; i < matches.size(); i++) {
+                    if ((long)graph->nodes.size() >= max_nodes) {
+                        return;
+                    }
+                    merge(graph, cls, instantiate(graph, rhs, matches[i]));
+                }
+            }
+        }
+    }
+}
+
+//! \brief Cost of one operation
+static double
+operation_cost(int cost_model, int operation) {
+    if (cost_model == COST_NODES) {
+        return 1;
+    }
+    switch (operation) {
+        case MUL:
+            return 2;
+        case DIV:
+            return 4;
+        case POWER:
+            return 8;
+        case LN:
+        case SIN:
+        case COS:
+            return 16;
+        default:
+            return 1;
+    }
+}
+
+//! \brief Build the cheapest tree of e-class
+static Node *
+build_tree(struct E_Graph *graph, std::vector<int> &best, int cls) {
+    E_Node &node = graph->nodes[best[find(graph, cls)]];
+    if (node.operation == CONSTANT) {
+        return new Node(node.value);
+    }
+    if (node.operation == VAR) {
+        return new Node(VAR, node.name);
+    }
+    Node *root = new Node(node.operation);
+    for (size_t i = 0; i < node.children.size(); i++) {
+        root->add_child(build_tree(graph, best, node.children[i]));
+    }
+    return root;
+}
+
+//! \brief Extract the cheapest equivalent tree
+//! \param [in] graph E-graph
+//! \param [in] root Root e-class
+//! \param [in] cost_model One of Cost_Models
+//! \return Returns new tree
+static Node *
+extract(struct E_Graph *graph, int root, int cost_model) {
+    int classes = graph->parent.size();
+    std::vector<double> cost(classes, INFINITY);
+    std::vector<int> best(classes, -1);
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int cls = 0; cls < classes; cls++) {
+            if (find(graph, cls) != cls) {
+                continue;
+            }
+            for (size_t i = 0; i < graph->class_nodes[cls].size(); i++) {
+                E_Node &node = graph->nodes[graph->class_nodes[cls][i]];
+                double cur = operation_cost(cost_model, node.operation);
+                for (size_t j = 0; j < node.children.size(); j++) {
+                    cur += cost[find(graph, node.children[j])];
+                }
+                if (cur < cost[cls]) {
+                    cost[cls] = cur;
+                    best[cls] = graph->class_nodes[cls][i];
+                    changed = true;
+                }
+            }
+        }
+    }
+    return build_tree(graph, best, root);
+}
+
+//! \brief Simplify expression by equality saturation: apply all identities
+//! without removing anything, then extract the cheapest equivalent tree
+//! \param [in] root Expression
+//! \param [in] cost_model One of Cost_Models
+//! \param [in] max_nodes Limit of e-nodes
+//! \param [in] max_iterations Limit of rule application rounds
+//! \return Returns new tree or NULL, if root is not an expression (program)
+Node *
+egraph_simplify(Node *root, int cost_model, long max_nodes, int max_iterations) {
+    static struct Rule_Set *egraph_rules = compile_rules(egraph_rules_text,
+            sizeof(egraph_rules_text) / sizeof(egraph_rules_text[0]));
+    struct Rule_Set *rules[] = {simplify_rules(), egraph_rules};
+
+    struct E_Graph graph;
+    graph.unions = 0;
+    graph.dirty = false;
+    int cls = add_tree(&graph, root);
+    if (cls < 0) {
+        return NULL;
+    }
+    rebuild(&graph);
+    for (int i = 0; i < max_iterations && (long)graph.nodes.size() < max_nodes; i++) {
+        STAT_INC(EGRAPH_ITERATIONS);
+        long unions = graph.unions;
+        size_t nodes = graph.nodes.size();
+        apply_rules(&graph, rules, sizeof(rules) / sizeof(rules[0]), max_nodes);
+        rebuild(&graph);
+        if (unions == graph.unions && nodes == graph.nodes.size()) {
+            break; // saturated
+        }
+    }
+    return extract(&graph, cls, cost_model);
+}
+
+//! \brief Recognize cost model name
+//! \param [in] name "nodes" or "eval"
+//! \return Returns one of Cost_Models or -1
+int
+parse_cost_model(const char *name) {
+    if (!strcmp(name, "nodes")) {
+        return COST_NODES;
+    }
+    if (!strcmp(name, "eval")) {
+        return COST_EVAL;
+    }
+    return -1;
+}
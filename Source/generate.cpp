@@ -0,0 +1,383 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "generate.h"
+#include "columns.h"
+
+//! \brief Generator state: parameters and random sequence
+struct Gen_State {
+    struct Gen_Params *params;
+    unsigned long long rand_state;
+    int ops_len;
+    bool has_unary;
+    bool has_binary;
+    long emitted;
+    int funcs;
+};
+
+//! \brief Fill parameters with defaults
+//! \param [out] params Parameters to fill
+void
+gen_default_params(struct Gen_Params *params) {
+    params->nodes = GEN_DEFAULT_NODES;
+    params->depth = GEN_DEFAULT_DEPTH;
+    params->fanout = GEN_DEFAULT_FANOUT;
+    params->ops = "++--**/^scl";
+    params->vars = GEN_DEFAULT_VARS;
+    params->seed = 1;
+}
+
+//! \brief Next pseudo random number (splitmix64), depends only on the seed
+//! \param [in,out] state Generator state
+//! \return Returns random number
+static unsigned long long
+gen_rand(struct Gen_State *state) {
+    unsigned long long z = (state->rand_state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static bool
+is_unary(char op) {
+    return op == 's' || op == 'c' || op == 'l';
+}
+
+static const char *
+unary_name(char op) {
+    switch (op) {
+        case 's':
+            return "sin";
+        case 'c':
+            return "cos";
+        default:
+            return "ln";
+    }
+}
+
+//! \brief Prepare state for generation
+//! \param [out] state State to fill
+//! \param [in] params Generation parameters
+static void
+gen_init(struct Gen_State *state, struct Gen_Params *params) {
+    state->params = params;
+    state->rand_state = params->seed;
+    state->ops_len = strlen(params->ops);
+    state->has_unary = false;
+    state->has_binary = false;
+    for (int i = 0; i < state->ops_len; i++) {
+        if (is_unary(params->ops[i])) {
+            state->has_unary = true;
+        } else {
+            state->has_binary = true;
+        }
+    }
+    state->emitted = 0;
+    state->funcs = 0;
+}
+
+//! \brief Pick random operation with required arity
+//! \param [in] state Generator state
+//! \param [in] unary Need unary operation
+//! \return Returns operation symbol
+static char
+pick_op(struct Gen_State *state, bool unary) {
+    while (true) {
+        char op = state->params->ops[gen_rand(state) % state->ops_len];
+        if (is_unary(op) == unary) {
+            return op;
+        }
+    }
+}
+
+//! \brief Print name of the variable with given index: x, y, z, v3, v4, ...
+static void
+print_var(FILE *out, int ind) {
+    if (ind < 3) {
+        fputc("xyz"[ind], out);
+    } else {
+        fprintf(out, "v%d", ind);
+    }
+}
+
+//! \brief Print leaf: variable or constant
+//! \param [in] out Output stream
+//! \param [in] state Generator state
+static void
+print_leaf(FILE *out, struct Gen_State *state) {
+    if (state->params->vars > 0 && gen_rand(state) % 2) {
+        print_var(out, gen_rand(state) % state->params->vars);
+    } else {
+        fprintf(out, "%d", (int)(gen_rand(state) % 9) + 1);
+    }
+    state->emitted++;
+}
+
+//! \brief Recursively print full-parenthesis expression
+//! \param [in] out Output stream
+//! \param [in] state Generator state
+//! \param [in] nodes Node budget of this subtree
+//! \param [in] depth Remaining depth
+static void
+gen_full_pars_rec(FILE *out, struct Gen_State *state, long nodes, int depth) {
+    bool unary = false;
+    if (nodes <= 1 || depth <= 1 || !state->ops_len) {
+        fputc('(', out);
+        print_leaf(out, state);
+        fputc(')', out);
+        return;
+    }
+    if (nodes == 2 || !state->has_binary) {
+        unary = state->has_unary;
+    } else if (state->has_unary) {
+        unary = is_unary(state->params->ops[gen_rand(state) % state->ops_len]);
+    }
+    if (nodes == 2 && !unary) {
+        nodes = 1;
+        gen_full_pars_rec(out, state, nodes, depth);
+        return;
+    }
+
+    state->emitted++;
+    if (unary) {
+        fprintf(out, "(%s", unary_name(pick_op(state, true)));
+        gen_full_pars_rec(out, state, nodes - 1, depth - 1);
+        fputc(')', out);
+        return;
+    }
+
+    char op = pick_op(state, false);
+    long children = 2;
+    if (state->params->fanout > 2) {
+        children += gen_rand(state) % (state->params->fanout - 1);
+    }
+    if (children > nodes - 1) {
+        children = nodes - 1;
+    }
+    long rest = nodes - 1;
+    fputc('(', out);
+    for (long i = 0; i < children; i++) {
+        long part = rest / (children - i);
+        if (i != children - 1 && part > 1) { // shift the split, so trees are not perfectly balanced
+            part += (long)(gen_rand(state) % part) - part / 2;
+        }
+        if (part > rest - (children - i - 1)) {
+            part = rest - (children - i - 1);
+        }
+        if (i) {
+            fprintf(out, " %c ", op);
+        }
+        gen_full_pars_rec(out, state, part, depth - 1);
+        rest -= part;
+    }
+    fputc(')', out);
+}
+
+//! \brief Print expression in full-parenthesis format (input of tree)
+//! \param [in] out Output stream
+//! \param [in] params Generation parameters
+//! \return Returns number of generated nodes
+long
+gen_expression(FILE *out, struct Gen_Params *params) {
+    struct Gen_State state;
+    gen_init(&state, params);
+    gen_full_pars_rec(out, &state, params->nodes, params->depth);
+    fputc('\n', out);
+    return state.emitted;
+}
+
+//! \brief Recursively print expression in rec_desc syntax
+//! \param [in] out Output stream
+//! \param [in] state Generator state
+//! \param [in] nodes Node budget of this subtree
+static void
+gen_rec_expr(FILE *out, struct Gen_State *state, long nodes) {
+    if (nodes <= 1 || !state->ops_len) {
+        print_leaf(out, state);
+        return;
+    }
+    state->emitted++;
+    if (nodes == 2 || (state->has_unary && is_unary(state->params->ops[gen_rand(state) % state->ops_len]))) {
+        if (state->has_unary) {
+            fprintf(out, "%s(", unary_name(pick_op(state, true)));
+            gen_rec_expr(out, state, nodes - 1);
+            fputc(')', out);
+            return;
+        }
+        nodes = 3;
+    }
+    long left = (nodes - 1) / 2;
+    fputc('(', out);
+    gen_rec_expr(out, state, left);
+    fprintf(out, " %c ", pick_op(state, false));
+    gen_rec_expr(out, state, nodes - 1 - left);
+    fputc(')', out);
+}
+
+//! \brief Print condition: expr < expr, expr > expr or expr ~ expr
+static void
+gen_condition(FILE *out, struct Gen_State *state) {
+    state->emitted++;
+    gen_rec_expr(out, state, GEN_EXPR_IN_STATEMENT / 2);
+    fprintf(out, " %c ", "<>~"[gen_rand(state) % 3]);
+    gen_rec_expr(out, state, GEN_EXPR_IN_STATEMENT / 2);
+}
+
+static void
+indent(FILE *out, int level) {
+    for (int i = 0; i < level; i++) {
+        fputs("    ", out);
+    }
+}
+
+static void gen_statement(FILE *out, struct Gen_State *state, int level);
+
+//! \brief Print sequence of statements inside { }, when the node budget is
+//! spent, the block ends after its first statement
+static void
+gen_block(FILE *out, struct Gen_State *state, int level, int statements) {
+    state->emitted++; // DO_IN_ORDER
+    fputs("{\n", out);
+    for (int i = 0; i < statements && (!i || state->emitted < state->params->nodes); i++) {
+        gen_statement(out, state, level + 1);
+    }
+    indent(out, level);
+    fputc('}', out);
+}
+
+//! \brief Print one statement: assignment, call, if, while, for or return
+//! \param [in] out Output stream
+//! \param [in] state Generator state
+//! \param [in] level Nesting level
+static void
+gen_statement(FILE *out, struct Gen_State *state, int level) {
+    int kind = gen_rand(state) % 8;
+    int vars = state->params->vars > 0 ? state->params->vars : 1;
+    if (level >= state->params->depth || state->emitted >= state->params->nodes) {
+        kind = 0;
+    }
+    indent(out, level);
+    switch (kind) {
+        case 1:
+            state->emitted++;
+            fputs("if (", out);
+            gen_condition(out, state);
+            fputs(") ", out);
+            gen_block(out, state, level, 1 + gen_rand(state) % 3);
+            if (gen_rand(state) % 2) {
+                fputs(" else ", out);
+                gen_block(out, state, level, 1 + gen_rand(state) % 3);
+            }
+            fputc('\n', out);
+            return;
+        case 2:
+            state->emitted++;
+            fputs("while (", out);
+            gen_condition(out, state);
+            fputs(") ", out);
+            gen_block(out, state, level, 1 + gen_rand(state) % 3);
+            fputc('\n', out);
+            return;
+        case 3:
+            state->emitted += 10;
+            fputs("for (i = 0; i < ", out);
+            gen_rec_expr(out, state, 1);
+            fputs("; i = i + 1) ", out);
+            gen_block(out, state, level, 1 + gen_rand(state) % 3);
+            fputc('\n', out);
+            return;
+        case 4:
+            if (state->funcs > 0) {
+                state->emitted++;
+                fprintf(out, "f%d(", (int)(gen_rand(state) % state->funcs));
+                gen_rec_expr(out, state, GEN_EXPR_IN_STATEMENT / 2);
+                fputs(", ", out);
+                gen_rec_expr(out, state, GEN_EXPR_IN_STATEMENT / 2);
+                fputs(");\n", out);
+                return;
+            }
+            break;
+        case 5:
+            state->emitted++;
+            fputs("return (", out);
+            gen_rec_expr(out, state, GEN_EXPR_IN_STATEMENT);
+            fputs(");\n", out);
+            return;
+        default:
+            break;
+    }
+    state->emitted += 2;
+    print_var(out, gen_rand(state) % vars);
+    fputs(" = ", out);
+    gen_rec_expr(out, state, GEN_EXPR_IN_STATEMENT);
+    fputs(";\n", out);
+}
+
+//! \brief Print program for rec_desc: set of functions f0, f1, ... and main
+//! \param [in] out Output stream
+//! \param [in] params Generation parameters
+//! \return Returns approximate number of nodes in the parsed program
+long
+gen_program(FILE *out, struct Gen_Params *params) {
+    struct Gen_State state;
+    gen_init(&state, params);
+    state.emitted = 1; // root DO_IN_ORDER
+    do {
+        state.emitted += 3; // FUNC_DEF and two params
+        fprintf(out, "function f%d(x, y) ", state.funcs);
+        gen_block(out, &state, 0, GEN_STATEMENTS_IN_FUNC);
+        fputs("\n\n", out);
+        state.funcs++;
+    } while (state.emitted < params->nodes);
+
+    state.emitted += 2;
+    fputs("function main() {\n", out);
+    indent(out, 1);
+    fprintf(out, "return (f%d(1, 2));\n}\n", state.funcs - 1);
+    return state.emitted;
+}
+
+//! \brief Print columnar file for tree --eval: one column of values per
+//! variable (x, y, z, v3, ...), values are uniform in [GEN_MIN_VALUE, GEN_MAX_VALUE)
+//! \param [in] out Output stream
+//! \param [in] params Generation parameters: nodes is the number of rows
+//! \return Returns number of generated values
+long
+gen_columns(FILE *out, struct Gen_Params *params) {
+    struct Gen_State state;
+    gen_init(&state, params);
+    int vars = params->vars > 0 ? params->vars : 1;
+    std::string names;
+    for (int i = 0; i < vars; i++) {
+        names += i < 3 ? std::string(1, "xyz"[i]) : "v" + std::to_string(i);
+        names += '\0';
+    }
+    struct Col_Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, COL_MAGIC, sizeof(COL_MAGIC));
+    header.version = COL_VERSION;
+    header.columns_num = vars;
+    header.names_size = names.size();
+    header.rows = params->nodes;
+    header.names_offset = sizeof(header);
+    header.data_offset = (sizeof(header) + names.size() + 7) / 8 * 8;
+    names.resize(header.data_offset - sizeof(header), '\0');
+    fwrite(&header, sizeof(header), 1, out);
+    fwrite(names.data(), 1, names.size(), out);
+
+    std::vector<double> block(GEN_COLUMNS_BLOCK);
+    for (int i = 0; i < vars; i++) {
+        for (long row = 0; row < params->nodes; row += block.size()) {
+            long count = std::min((long)block.size(), params->nodes - row);
+            for (long j = 0; j < count; j++) {
+                double unit = (gen_rand(&state) >> 11) * (1.0 / (1ULL << 53));
+                block[j] = GEN_MIN_VALUE + unit * (GEN_MAX_VALUE - GEN_MIN_VALUE);
+            }
+            fwrite(block.data(), sizeof(double), count, out);
+        }
+    }
+    return (long)vars * params->nodes;
+}
@@ -0,0 +1,315 @@
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <sys/stat.h>
+
+#include "tree.h"
+#include "html_view.h"
+#include "stats.h"
+
+//! \brief Children lists of the tree, packed into chunks: the list of a node
+//! is loaded with its chunk, when the node is expanded in the viewer
+struct Html_Chunks {
+    std::vector<Node *> parents;            // nodes with children, by key
+    std::vector<int> chunks;                // chunk of the children list, by key
+    std::unordered_map<Node *, long> keys;
+    int chunks_num;
+};
+
+//! \brief Colors of nodes, as in Node::visualize_tree_rec
+static const char *html_palette = "[\"yellow\", \"darkgrey\", \"green\", \"blue\", \"pink\", \"red\", \"lightgrey\"]";
+
+//! \brief Index of the node color in html_palette
+static int
+html_color(int operation) {
+    switch (operation) {
+        case CONSTANT:
+            return 0;
+        case VAR:
+            return 2;
+        case FUNC_CALL:
+            return 3;
+        case FUNC_DEF:
+            return 4;
+        case RETURN:
+            return 5;
+        case FOR:
+        case WHILE:
+        case IF:
+            return 6;
+        default:
+            return 1;
+    }
+}
+
+//! \brief Pack children lists into chunks of at most HTML_CHUNK_NODES records.
+//! Lists are taken breadth first from the root, so the first chunk holds the top
+//! of the tree; lists, which do not fit, start the next chunks in the same order,
+//! so every expansion loads a bounded chunk
+//! \param [in] root Root of the tree
+//! \param [out] res Chunks
+static void
+pack_chunks(Node *root, struct Html_Chunks *res) {
+    std::deque<Node *> starts(1, root);
+    int chunk = 0;
+    long fill = 0;
+    while (!starts.empty()) {
+        Node *start = starts.front();
+        starts.pop_front();
+        std::deque<Node *> queue(1, start);
+        while (!queue.empty()) {
+            Node *node = queue.front();
+            queue.pop_front();
+            int children = node->get_children_number();
+            if (!children) {
+                continue;
+            }
+            if (fill && fill + children > HTML_CHUNK_NODES) {
+                if (node != start) {
+                    starts.push_back(node);
+                    continue;
+                }
+                chunk++;
+                fill = 0;
+            }
+            res->keys[node] = res->parents.size();
+            res->parents.push_back(node);
+            res->chunks.push_back(chunk);
+            fill += children;
+            Node **childs = node->get_childs();
+            queue.insert(queue.end(), childs, childs + children);
+        }
+    }
+    res->chunks_num = chunk + 1;
+}
+
+//! \brief Write string in JSON, '<' is escaped, so it never closes the script
+static void
+write_json_string(FILE *out, const char *str) {
+    fputc('"', out);
+    for (const unsigned char *c = (const unsigned char *)str; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(out, "\\%c", *c);
+        } else if (*c < 0x20 || *c == '<') {
+            fprintf(out, "\\u%04x", *c);
+        } else {
+            fputc(*c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+//! \brief Write node record: [label, color] for leaf,
+//! [label, color, children number, chunk of children, key of children] else
+static void
+write_record(FILE *out, Node *node, const struct Html_Chunks *chunks) {
+    fputc('[', out);
+    if (node->get_operation() == CONSTANT) {
+        fprintf(out, "\"%lf\"", node->get_value());
+    } else {
+        write_json_string(out, node->get_name());
+    }
+    fprintf(out, ",%d", html_color(node->get_operation()));
+    int children = node->get_children_number();
+    if (children) {
+        long key = chunks->keys.at(node);
+        fprintf(out, ",%d,%d,%ld", children, chunks->chunks[key], key);
+    }
+    fputc(']', out);
+}
+
+//! \brief Write one chunk as script: tree_chunk(chunk, {key: [records of children]})
+//! \param [in] first Key of the first list of the chunk, is moved to the next chunk
+static void
+write_chunk(FILE *out, const struct Html_Chunks *chunks, int chunk, size_t *first) {
+    fprintf(out, "tree_chunk(%d, {", chunk);
+    size_t key = *first;
+    for (; key < chunks->parents.size() && chunks->chunks[key] == chunk; key++) {
+        Node *parent = chunks->parents[key];
+        fprintf(out, "%s\"%zu\":[", key == *first ? "" : ",\n", key);
+        for (int i = 0; i < parent->get_children_number(); i++) {
+            if (i) {
+                fputc(',', out);
+            }
+            write_record(out, parent->get_childs()[i], chunks);
+        }
+        fputc(']', out);
+    }
+    fprintf(out, "});\n");
+    *first = key;
+}
+
+//! \brief Close file, written by stdio
+//! \return Returns 0 in success -1 else
+static int
+close_out(FILE *out, const char *name) {
+    STAT_ADD(BYTES_WRITTEN, ftell(out));
+    if (ferror(out) | fclose(out)) {
+        fprintf(stderr, "Can not write %s\n", name);
+        return -1;
+    }
+    return 0;
+}
+
+//! \brief Viewer: nodes are expanded by click, chunk with children is loaded
+//! by script tag (works from file://), long lists are shown by pages
+static const char *html_viewer =
+"var lists = {};\n"
+"var loaded = {};\n"
+"var waiting = {};\n"
+"function tree_chunk(chunk, chunk_lists) {\n"
+"    for (var key in chunk_lists) {\n"
+"        lists[key] = chunk_lists[key];\n"
+"    }\n"
+"    loaded[chunk] = true;\n"
+"    var then = waiting[chunk] || [];\n"
+"    delete waiting[chunk];\n"
+"    then.forEach(function (f) { f(); });\n"
+"}\n"
+"function load(chunk, then) {\n"
+"    if (loaded[chunk]) {\n"
+"        then();\n"
+"        return;\n"
+"    }\n"
+"    if (waiting[chunk]) {\n"
+"        waiting[chunk].push(then);\n"
+"        return;\n"
+"    }\n"
+"    waiting[chunk] = [then];\n"
+"    var script = document.createElement(\"script\");\n"
+"    script.src = chunk_dir + \"c\" + chunk + \".js\";\n"
+"    script.onerror = function () { delete waiting[chunk]; alert(\"Can not load \" + script.src); };\n"
+"    document.head.appendChild(script);\n"
+"}\n"
+"function show(ul, list, from) {\n"
+"    var to = Math.min(list.length, from + page);\n"
+"    for (var i = from; i < to; i++) {\n"
+"        ul.appendChild(make(list[i]));\n"
+"    }\n"
+"    if (to < list.length) {\n"
+"        var more = document.createElement(\"li\");\n"
+"        more.className = \"more\";\n"
+"        more.textContent = \"more (\" + (list.length - to) + \")\";\n"
+"        more.onclick = function () { ul.removeChild(more); show(ul, list, to); };\n"
+"        ul.appendChild(more);\n"
+"    }\n"
+"}\n"
+"function make(rec) {\n"
+"    var li = document.createElement(\"li\");\n"
+"    var toggle = document.createElement(\"span\");\n"
+"    var label = document.createElement(\"span\");\n"
+"    toggle.className = \"toggle\";\n"
+"    label.className = rec.length > 2 ? \"node\" : \"node leaf\";\n"
+"    label.style.background = palette[rec[1]];\n"
+"    label.textContent = rec[0];\n"
+"    li.appendChild(toggle);\n"
+"    li.appendChild(label);\n"
+"    if (rec.length > 2) {\n"
+"        var ul = null;\n"
+"        var loading = false;\n"
+"        toggle.textContent = \"+\";\n"
+"        label.title = rec[2] + \" children\";\n"
+"        toggle.onclick = function () {\n"
+"            if (ul) {\n"
+"                var hidden = ul.style.display == \"none\";\n"
+"                ul.style.display = hidden ? \"\" : \"none\";\n"
+"                toggle.textContent = hidden ? \"-\" : \"+\";\n"
+"                return;\n"
+"            }\n"
+"            if (loading) {\n"
+"                return;\n"
+"            }\n"
+"            loading = true;\n"
+"            toggle.textContent = \"...\";\n"
+"            load(rec[3], function () {\n"
+"                ul = document.createElement(\"ul\");\n"
+"                show(ul, lists[rec[4]], 0);\n"
+"                li.appendChild(ul);\n"
+"                toggle.textContent = \"-\";\n"
+"            });\n"
+"        };\n"
+"    }\n"
+"    return li;\n"
+"}\n";
+
+static const char *html_style =
+"body { font-family: monospace; }\n"
+"ul { list-style: none; padding-left: 20px; margin: 0; }\n"
+".node { display: inline-block; padding: 0 6px; margin: 1px; border: 1px solid black; }\n"
+".leaf { border-radius: 8px; }\n"
+".toggle { display: inline-block; width: 24px; cursor: pointer; }\n"
+".more { cursor: pointer; text-decoration: underline; }\n";
+
+//! \brief Export tree into self-contained HTML viewer filename.html: the top of
+//! the tree is in the page, other children lists are in filename_html/c<N>.js and
+//! are loaded only, when their parent is expanded, so huge trees open at once
+//! \param [in] filename Base name of output files
+//! \param [in] root Tree
+//! \return Returns 0 in success 1 else
+int
+create_html(char *filename, Node *root) {
+    if (!root) {
+        return 1;
+    }
+    long long start = stats_begin(PHASE_EXPORT_HTML);
+    root->expand_lazy();
+    struct Html_Chunks chunks;
+    pack_chunks(root, &chunks);
+
+    std::string dir = std::string(filename) + "_html";
+    if (chunks.chunks_num > 1 && mkdir(dir.c_str(), S_IRWXU | S_IRWXG | S_IRWXO) && errno != EEXIST) {
+        fprintf(stderr, "Can not create directory %s\n", dir.c_str());
+        stats_add_time(PHASE_EXPORT_HTML, start);
+        return 1;
+    }
+    int res = 0;
+    size_t first = 0;
+    std::string html_name = std::string(filename) + ".html";
+    FILE *out = fopen(html_name.c_str(), "w");
+    if (!out) {
+        fprintf(stderr, "Can not open out file %s\n", html_name.c_str());
+        stats_add_time(PHASE_EXPORT_HTML, start);
+        return 1;
+    }
+    const char *base = strrchr(filename, '/');
+    base = base ? base + 1 : filename;
+    fprintf(out, "<!DOCTYPE html>\n<html><head><meta charset=\"utf-8\"><title>");
+    for (const char *c = base; *c; c++) { // title is text, not script
+        if (*c == '<' || *c == '&') {
+            fprintf(out, "&#%d;", *c);
+        } else {
+            fputc(*c, out);
+        }
+    }
+    fprintf(out, "</title>\n<style>\n%s</style></head>\n<body>\n<div id=\"tree\"></div>\n<script>\n", html_style);
+    fprintf(out, "var chunk_dir = ");
+    write_json_string(out, (std::string(base) + "_html/").c_str());
+    fprintf(out, ";\nvar page = %d;\nvar palette = %s;\n%s</script>\n<script>\n", HTML_PAGE_CHILDREN,
+            html_palette, html_viewer);
+    write_chunk(out, &chunks, 0, &first);
+    fprintf(out, "var root = document.createElement(\"ul\");\nroot.appendChild(make(");
+    write_record(out, root, &chunks);
+    fprintf(out, "));\ndocument.getElementById(\"tree\").appendChild(root);\n"
+                 "if (root.firstChild.firstChild.onclick) {\n"
+                 "    root.firstChild.firstChild.onclick();\n"
+                 "}\n</script>\n</body></html>\n");
+    res |= close_out(out, html_name.c_str());
+
+    for (int chunk = 1; chunk < chunks.chunks_num && !res; chunk++) {
+        std::string chunk_name = dir + "/c" + std::to_string(chunk) + ".js";
+        out = fopen(chunk_name.c_str(), "w");
+        if (!out) {
+            fprintf(stderr, "Can not open out file %s\n", chunk_name.c_str());
+            res = -1;
+            break;
+        }
+        write_chunk(out, &chunks, chunk, &first);
+        res |= close_out(out, chunk_name.c_str());
+    }
+    stats_add_time(PHASE_EXPORT_HTML, start);
+    return res ? 1 : 0;
+}
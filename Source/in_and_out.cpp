@@ -7,12 +7,34 @@
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <limits.h>
+
+#include "in_and_out.h"
 
 //! \brief Mmaps file to read
 //! \param [in] file_in Name of mmaped file
 //! \param [out] file_size Size of the mmaped area
 char *mmap_file(char *file_in, int *file_size) 
 {
+    long size = 0;
+    char *res = mmap_file(file_in, &size, false);
+    *file_size = size;
+    if (res && size > INT_MAX) {
+        fprintf(stderr, "Error: file %s is too big\n", file_in);
+        munmap(res, size);
+        return NULL;
+    }
+    return res;
+}
+
+//! \brief Mmaps file of any size to read
+//! \param [in] file_in Name of mmaped file
+//! \param [out] file_size Size of the mmaped area
+//! \param [in] sequential File is read once from the beginning to the end,
+//! so the kernel reads ahead more and drops read pages first
+//! \return Returns mmaped area or NULL
+char *
+mmap_file(char *file_in, long *file_size, bool sequential) {
     assert(file_in);
     struct stat file_stat;
     errno = 0;
@@ -35,13 +57,84 @@ char *mmap_file(char *file_in, int *file_size)
 
     // mmap file
     char *commands = (char *)mmap(NULL, file_in_size, PROT_READ, MAP_SHARED, fd_in, 0);
-    if (!commands) {
+    if (commands == MAP_FAILED) {
         fprintf(stderr, "Error: Can`t mmap file %s\n", file_in);
+        close(fd_in);
         return NULL;
     }
     if (close(fd_in)) {
         fprintf(stderr, "Error: Can`t close file descriptor %d\n", fd_in);
+        munmap(commands, file_in_size);
         return NULL;
     }
+    if (sequential) {
+        madvise(commands, file_in_size, MADV_SEQUENTIAL);
+    }
     return commands;
 }
+
+//! \brief Create file of the given size and mmap it to write
+//! \param [in] file_out Name of the file (it is truncated, if exists)
+//! \param [in] file_size Size of the file
+//! \return Returns mmaped area or NULL
+char *
+mmap_out_file(char *file_out, long file_size) {
+    assert(file_out);
+    int fd_out = open(file_out, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd_out < 0) {
+        fprintf(stderr, "Error: Can`t open file %s\n", file_out);
+        return NULL;
+    }
+    if (ftruncate(fd_out, file_size)) {
+        fprintf(stderr, "Error: Can`t resize file %s: %s\n", file_out, strerror(errno));
+        close(fd_out);
+        return NULL;
+    }
+    char *data = (char *)mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_out, 0);
+    close(fd_out);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "Error: Can`t mmap file %s\n", file_out);
+        return NULL;
+    }
+    madvise(data, file_size, MADV_SEQUENTIAL);
+    return data;
+}
+
+//! \brief Tell the kernel, that pages of [begin, end) of mmaped area are not
+//! needed any more: read pages are dropped, written ones are left to write back.
+//! Only pages, which are entirely inside of the range, are released
+//! \param [in] data Start of the mmaped area (page aligned)
+//! \param [in] begin, end Range of bytes
+void
+release_pages(char *data, long begin, long end) {
+    long page = sysconf(_SC_PAGESIZE);
+    begin = (begin + page - 1) / page * page;
+    end = end / page * page;
+    if (begin < end) {
+        madvise(data + begin, end - begin, MADV_DONTNEED);
+    }
+}
+
+//! \brief Check if command line argument is option '--name' or '--name=value'
+//! \param [in] arg Command line argument
+//! \param [in] name Option name with leading '--'
+//! \param [out] value Pointer to the value after '=' or NULL, if there is no value
+//! \return Returns true, if arg is this option
+bool
+match_option(char *arg, const char *name, char **value) {
+    assert(arg);
+    assert(name);
+    int name_len = strlen(name);
+    if (strncmp(arg, name, name_len)) {
+        return false;
+    }
+    if (arg[name_len] == '\0') {
+        *value = NULL;
+        return true;
+    }
+    if (arg[name_len] == '=') {
+        *value = arg + name_len + 1;
+        return true;
+    }
+    return false;
+}
@@ -6,11 +6,250 @@
 #include <cstring>
 #include <stdlib.h>
 #include <cerrno>
+#include <climits>
+#include <thread>
 
 #include "tree.h"
 #include "main.h"
 #include "in_and_out.h"
 #include "visualize.h"
+#include "stats.h"
+#include "trace.h"
+#include "bin_tree.h"
+#include "egraph.h"
+#include "taylor.h"
+#include "cse.h"
+#include "plot.h"
+#include "symbols.h"
+#include "tree_cache.h"
+#include "watch.h"
+#include "columns.h"
+#include "render.h"
+#include "render_cache.h"
+#include "html_view.h"
+
+//! \brief Simplify tree by simplify() or by e-graph
+//! \param [in] root Tree, is deleted if new one is created
+//! \param [in] cost_model Cost model for e-graph or -1 for simplify()
+//! \return Returns simplified tree
+static Node *
+simplify_tree(Node *root, int cost_model) {
+    long long start = stats_begin(PHASE_SIMPLIFY);
+    Node *res = NULL;
+    if (cost_model >= 0) {
+        root->expand_lazy();
+        res = egraph_simplify(root, cost_model, EGRAPH_MAX_NODES, EGRAPH_MAX_ITERATIONS);
+    }
+    if (res) {
+        rec_del(root);
+    } else {
+        root->simplify();
+        res = root;
+    }
+    stats_add_time(PHASE_SIMPLIFY, start);
+    return res;
+}
+
+//! \brief Options of tree and trees exported by the previous run (for --watch)
+struct Run {
+    char **inputs;
+    int inputs_num;
+    char *filename;
+    char *simp_name;
+    char *der_name;
+    int show_png;
+    int show_pdf;
+    bool emit_bin;
+    char *emit_bin_file;
+    bool load_bin;
+    int cost_model;
+    int order;
+    bool taylor;
+    double taylor_point;
+    bool cse;
+    struct Dot_Lod dot_lod;
+    bool dot_lod_used;
+    bool html;
+    bool plot;
+    double plot_from;
+    double plot_to;
+    int threads;
+    char *eval_file;
+    bool watch;
+    char *tex_doc_name;
+    struct Tex_Doc *tex_doc;
+    Node *shown[RUN_OUTPUTS];
+};
+
+//! \brief Captions of Run_Outputs in TeX document
+static const char *output_captions[RUN_OUTPUTS] = {
+    "Source:",
+    "Simplified:",
+    "Derivate:",
+};
+
+//! \brief Export tree into png and pdf, unless the same tree was exported by the previous run.
+//! With TeX document formula is added to it instead of own pdf
+//! \param [in] run Options
+//! \param [in] output Output from Run_Outputs
+//! \param [in] name Base name of files
+//! \param [in] tree Tree to export
+static void
+render(struct Run *run, int output, char *name, Node *tree) {
+    if (run->tex_doc) { // document is written again every run
+        tex_doc_add(run->tex_doc, output_captions[output], tree);
+    }
+    if (run->shown[output] && tree_same(run->shown[output], tree)) {
+        return;
+    }
+    if (run->html) {
+        create_html(name, tree);
+    } else {
+        create_png(name, tree, run->show_png, run->cse, run->dot_lod_used ? &run->dot_lod : NULL);
+    }
+    if (!run->tex_doc) {
+        create_pdf(name, tree, run->show_pdf);
+    }
+    if (run->watch) {
+        rec_del(run->shown[output]);
+        run->shown[output] = tree->copy();
+    }
+}
+
+//! \brief Parse input, export it, its simplification and derivate
+//! \param [in] arg Run options
+//! \return Returns 0 in success 1 else
+static int
+process_input(void *arg) {
+    struct Run *run = (struct Run *)arg;
+    long long start = stats_begin(PHASE_PARSE);
+    Node *root = NULL;
+    if (run->load_bin) {
+        struct Bin_Tree *bin = load_bin_tree(run->filename);
+        if (!bin) {
+            fprintf(stderr, "Can not load binary tree %s\n", run->filename);
+            return 1;
+        }
+        root = bin_build_tree(bin, 0);
+        unload_bin_tree(bin);
+    } else {
+        root = parse_file_create_tree(run->filename);
+    }
+    stats_add_time(PHASE_PARSE, start);
+    if (!root) {
+        return 1;
+    }
+    if (run->shown[OUT_SOURCE] && tree_same(run->shown[OUT_SOURCE], root)) {
+        rec_del(root); // nothing changed since the previous run
+        return 0;
+    }
+    if (run->tex_doc) {
+        tex_doc_section(run->tex_doc, run->filename);
+    }
+
+    if (run->emit_bin) {
+        char *bin_name = run->emit_bin_file;
+        int file_name_size = strlen(run->filename);
+        if (!bin_name) {
+            bin_name = (char *)calloc(file_name_size + sizeof(".bin"), sizeof(char));
+            snprintf(bin_name, file_name_size + sizeof(".bin"), "%s.bin", run->filename);
+        }
+        save_bin_tree(bin_name, root);
+        if (bin_name != run->emit_bin_file) {
+            free(bin_name);
+        }
+    }
+
+    render(run, OUT_SOURCE, run->filename, root);
+
+    char var[] = "x";
+    if (run->taylor) {
+        double ders[TAYLOR_MAX_ORDER + 1] = {};
+        if (!taylor_derivatives(root, intern_symbol(var), run->taylor_point, NULL, 0, run->order, ders)) {
+            for (int k = 0; k <= run->order; k++) {
+                printf("f^(%d)(%g) = %.15g\n", k, run->taylor_point, ders[k]);
+            }
+        }
+    }
+
+    root = simplify_tree(root, run->cost_model);
+    render(run, OUT_SIMP, run->simp_name, root);
+
+    start = stats_begin(PHASE_DERIVATE);
+    // the first derivate is built by simplify from the simplified operands
+    Node *der = (run->order == 1) ? root->derivate_lazy(intern_symbol(var)) : root->derivate(var, run->order);
+    stats_add_time(PHASE_DERIVATE, start);
+    der = simplify_tree(der, run->cost_model);
+    render(run, OUT_DER, run->der_name, der);
+
+    int res = 0;
+    if (run->plot) {
+        int file_name_size = strlen(run->filename);
+        char *plot_name = (char *)calloc(file_name_size + sizeof("_plot.svg"), sizeof(char));
+        snprintf(plot_name, file_name_size + sizeof("_plot.svg"), "%s_plot.svg", run->filename);
+        if (plot_svg(plot_name, root, der, run->order, intern_symbol(var), run->plot_from, run->plot_to, run->threads)) {
+            res = 1;
+        }
+        free(plot_name);
+    }
+
+    if (run->eval_file) {
+        int file_name_size = strlen(run->filename);
+        char *eval_name = (char *)calloc(file_name_size + sizeof("_eval.col"), sizeof(char));
+        snprintf(eval_name, file_name_size + sizeof("_eval.col"), "%s_eval.col", run->filename);
+        struct Cse_Dag *dag = cse_build(root);
+        if (columns_eval(dag, run->eval_file, eval_name, "f", run->threads)) {
+            res = 1;
+        }
+        cse_free(dag);
+        free(eval_name);
+    }
+
+    rec_del(root);
+    rec_del(der);
+    return res;
+}
+
+//! \brief Process all inputs, their formulas are collected into one TeX
+//! document, if it is asked, so pdftex is started once
+//! \param [in] arg Run options
+//! \return Returns 0 in success 1 else
+static int
+process_batch(void *arg) {
+    struct Run *run = (struct Run *)arg;
+    if (run->tex_doc_name) {
+        run->tex_doc = tex_doc_open(run->tex_doc_name);
+        if (!run->tex_doc) {
+            return 1;
+        }
+    }
+    int res = 0;
+    for (int i = 0; i < run->inputs_num; i++) {
+        run->filename = run->inputs[i];
+        int file_name_size = strlen(run->filename);
+        // root->simplify()
+        run->simp_name = (char *)calloc(file_name_size + sizeof("_simp"), sizeof(char));
+        snprintf(run->simp_name, file_name_size + sizeof("_simp"), "%s_simp", run->filename);
+        // root->derivate()
+        run->der_name = (char *)calloc(file_name_size + sizeof("_der"), sizeof(char));
+        snprintf(run->der_name, file_name_size + sizeof("_der"), "%s_der", run->filename);
+        if (process_input(run)) {
+            res = 1;
+        }
+        free(run->simp_name);
+        free(run->der_name);
+    }
+    if (run->tex_doc && tex_doc_close(run->tex_doc, run->show_pdf)) {
+        res = 1;
+    }
+    run->tex_doc = NULL;
+    render_wait(); // failed renders are reported, but do not fail the run
+    if (run->watch) { // viewers are opened once, they reload changed files themselves
+        run->show_png = 0;
+        run->show_pdf = 0;
+    }
+    return res;
+}
 
 int
 main(int argc, char **argv)
@@ -20,45 +259,186 @@ main(int argc, char **argv)
         return 1;
     }
 
+    struct Run run;
+    memset(&run, 0, sizeof(run));
+    run.inputs = (char **)calloc(argc, sizeof(*run.inputs));
+    if (!run.inputs) {
+        fprintf(stderr, "Can not allocate memory\n");
+        return 1;
+    }
+    run.inputs[run.inputs_num++] = argv[FILE_IN];
     errno = 0;
-    int show_png = strtol(argv[SHOW_PNG], NULL, 10);
+    run.show_png = strtol(argv[SHOW_PNG], NULL, 10);
     if (errno) {
         fprintf(stderr, "Wrong input argument %s: expected int\n", argv[SHOW_PNG]);
         return 1;
     }
     
-    int show_pdf = strtol(argv[SHOW_PDF], NULL, 10);
+    run.show_pdf = strtol(argv[SHOW_PDF], NULL, 10);
     if (errno) {
         fprintf(stderr, "Wrong input argument %s: expected int\n", argv[SHOW_PDF]);
     }
 
-    int file_name_size = strlen(argv[FILE_IN]);
-    // root->simplify()
-    char *simp_name = (char *)calloc(1, file_name_size + 5);
-    strncpy(simp_name, argv[FILE_IN], file_name_size);
-    strncpy(simp_name + file_name_size, "_simp", 6);
-    
-    // root->derivate()
-    char *der_name = (char *)calloc(1, file_name_size + 4);
-    strncpy(der_name, argv[FILE_IN], file_name_size);
-    strncpy(der_name + file_name_size, "_der", 5);
-
-    Node *root = parse_file_create_tree(argv[FILE_IN]);
+    bool stats = false;
+    char *stats_file = NULL;
+    bool tex_doc = false;
+    int jobs = 0;
+    char *trace_file = NULL;
+    run.cost_model = -1;
+    run.order = 1;
+    run.threads = std::thread::hardware_concurrency();
+    if (run.threads < 1) {
+        run.threads = 1;
+    }
+    for (int i = ARG_NUM; i < argc; i++) {
+        char *value = NULL;
+        if (match_option(argv[i], "--stats", &value)) { // --stats or --stats=file.json
+            stats = true;
+            stats_file = value;
+        } else if (match_option(argv[i], "--trace", &value) && value) {
+            trace_enabled = true;
+            trace_file = value;
+        } else if (match_option(argv[i], "--trace-min-nodes", &value) && value) {
+            errno = 0;
+            char *end = NULL;
+            trace_min_nodes = strtol(value, &end, 10);
+            if (errno || end == value || *end || trace_min_nodes < 0) {
+                fprintf(stderr, "Wrong trace min nodes %s: expected non-negative int\n", value);
+                return 1;
+            }
+        } else if (match_option(argv[i], "--emit-bin", &value)) { // --emit-bin or --emit-bin=file.bin
+            run.emit_bin = true;
+            run.emit_bin_file = value;
+        } else if (match_option(argv[i], "--load-bin", &value) && !value) {
+            run.load_bin = true;
+        } else if (match_option(argv[i], "--egraph", &value)) { // --egraph or --egraph=nodes|eval
+            run.cost_model = value ? parse_cost_model(value) : COST_NODES;
+            if (run.cost_model < 0) {
+                fprintf(stderr, "Unknown cost model %s: expected nodes or eval\n", value);
+                return 1;
+            }
+        } else if (match_option(argv[i], "--order", &value) && value) {
+            errno = 0;
+            char *end = NULL;
+            long order = strtol(value, &end, 10);
+            if (errno || end == value || *end || order < 1 || order > TAYLOR_MAX_ORDER) {
+                fprintf(stderr, "Wrong order %s: expected 1..%d\n", value, TAYLOR_MAX_ORDER);
+                return 1;
+            }
+            run.order = order;
+        } else if (match_option(argv[i], "--plot", &value) && value) {
+            if (parse_plot_range(value, &run.plot_from, &run.plot_to)) {
+                fprintf(stderr, "Wrong plot range %s: expected from:to\n", value);
+                return 1;
+            }
+            run.plot = true;
+        } else if (match_option(argv[i], "--eval", &value) && value) {
+            run.eval_file = value;
+        } else if (match_option(argv[i], "--threads", &value) && value) {
+            errno = 0;
+            char *end = NULL;
+            long threads = strtol(value, &end, 10);
+            if (errno || end == value || *end || threads < 1 || threads > INT_MAX) {
+                fprintf(stderr, "Wrong number of threads %s: expected positive int\n", value);
+                return 1;
+            }
+            run.threads = threads;
+        } else if (match_option(argv[i], "--jobs", &value) && value) {
+            errno = 0;
+            char *end = NULL;
+            long num = strtol(value, &end, 10);
+            if (errno || end == value || *end || num < 1 || num > INT_MAX) {
+                fprintf(stderr, "Wrong number of jobs %s: expected positive int\n", value);
+                return 1;
+            }
+            jobs = num;
+        } else if (match_option(argv[i], "--dot-depth", &value) && value) {
+            errno = 0;
+            char *end = NULL;
+            long depth = strtol(value, &end, 10);
+            if (errno || end == value || *end || depth < 1 || depth > INT_MAX) {
+                fprintf(stderr, "Wrong dot depth %s: expected positive int\n", value);
+                return 1;
+            }
+            run.dot_lod.max_depth = depth;
+            run.dot_lod_used = true;
+        } else if (match_option(argv[i], "--dot-nodes", &value) && value) {
+            errno = 0;
+            char *end = NULL;
+            run.dot_lod.max_nodes = strtol(value, &end, 10);
+            if (errno || end == value || *end || run.dot_lod.max_nodes < 1) {
+                fprintf(stderr, "Wrong number of dot nodes %s: expected positive int\n", value);
+                return 1;
+            }
+            run.dot_lod_used = true;
+        } else if (match_option(argv[i], "--dot-path", &value) && value) {
+            run.dot_lod.path = value;
+            run.dot_lod_used = true;
+        } else if (match_option(argv[i], "--html", &value) && !value) {
+            run.html = true;
+        } else if (match_option(argv[i], "--cse", &value) && !value) {
+            run.cse = true;
+        } else if (match_option(argv[i], "--taylor", &value) && value) {
+            errno = 0;
+            char *end = NULL;
+            run.taylor_point = strtod(value, &end);
+            if (errno || end == value || *end) {
+                fprintf(stderr, "Wrong taylor point %s: expected number\n", value);
+                return 1;
+            }
+            run.taylor = true;
+        } else if (match_option(argv[i], "--watch", &value) && !value) {
+            run.watch = true;
+        } else if (match_option(argv[i], "--render-cache", &value)) { // --render-cache or --render-cache=dir
+            if (render_cache_open(value, RENDER_CACHE_MAX_BYTES)) {
+                return 1;
+            }
+        } else if (match_option(argv[i], "--tex-doc", &value)) { // --tex-doc or --tex-doc=name
+            tex_doc = true;
+            run.tex_doc_name = value;
+        } else if (strncmp(argv[i], "--", 2)) { // more inputs of the batch
+            run.inputs[run.inputs_num++] = argv[i];
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    render_jobs(jobs ? jobs : run.threads);
+    if (run.watch && run.inputs_num > 1) {
+        fprintf(stderr, "--watch works with one input file\n");
+        return 1;
+    }
+    char *tex_doc_name = NULL;
+    if (tex_doc && !run.tex_doc_name) { // input_all.tex by default
+        int file_name_size = strlen(argv[FILE_IN]);
+        tex_doc_name = (char *)calloc(file_name_size + sizeof("_all"), sizeof(char));
+        snprintf(tex_doc_name, file_name_size + sizeof("_all"), "%s_all", argv[FILE_IN]);
+        run.tex_doc_name = tex_doc_name;
+    }
+    long long total_start = stats_begin(PHASE_TOTAL);
 
-    create_png(argv[FILE_IN], root, show_png);
-    create_pdf(argv[FILE_IN], root, show_pdf);
-    
-    root->simplify();
-    create_png(simp_name, root, show_png);
-    create_pdf(simp_name, root, show_pdf);
+    int res = 0;
+    if (run.watch) {
+        simplify_cache = tree_cache_create(TREE_CACHE_MAX_NODES);
+        res = watch_file(argv[FILE_IN], process_batch, &run) ? 1 : 0;
+        tree_cache_free(simplify_cache);
+        simplify_cache = NULL;
+        for (int i = 0; i < RUN_OUTPUTS; i++) {
+            rec_del(run.shown[i]);
+        }
+    } else {
+        res = process_batch(&run);
+    }
+    free(tex_doc_name);
+    free(run.inputs);
+    render_cache_close();
 
-    char var[] = "x";
-    Node *der = root->derivate(var);
-    der->simplify();
-    create_png(der_name, der, show_png);
-    create_pdf(der_name, der, show_pdf);
-    
-    rec_del(root);
-    rec_del(der);
-    return 0;
+    stats_add_time(PHASE_TOTAL, total_start);
+    if (stats) {
+        stats_write(stats_file, "tree", argv[FILE_IN]);
+    }
+    if (trace_enabled) {
+        trace_write(trace_file);
+    }
+    return res;
 }
@@ -0,0 +1,113 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+
+#include "generate.h"
+
+//! \brief Read positive integer option
+//! \param [in] arg Option argument
+//! \param [out] res Read value
+//! \return Returns 0 in success, -1 else
+static int
+read_positive(char *arg, long *res) {
+    errno = 0;
+    char *end = NULL;
+    *res = strtol(arg, &end, 10);
+    if (errno || end == arg || *end || *res < 0) {
+        fprintf(stderr, "Wrong option argument %s: expected non-negative int\n", arg);
+        return -1;
+    }
+    return 0;
+}
+
+static void
+usage(char *name) {
+    fprintf(stderr, "Usage: %s expr|prog|cols [-n nodes] [-d depth] [-f fanout] [-o ops] [-v vars] [-s seed]\n"
+            "  expr  full-parenthesis expression for tree\n"
+            "  prog  program for rec_desc\n"
+            "  cols  columnar file with values of vars for tree --eval, nodes is the number of rows\n"
+            "  ops   operation mix, repeat symbol to raise its weight: '+-*/^' and s(in), c(os), l(n)\n",
+            name);
+}
+
+int
+main(int argc, char **argv) {
+    if (argc < 2 || (strcmp(argv[1], "expr") && strcmp(argv[1], "prog") && strcmp(argv[1], "cols"))) {
+        usage(argv[0]);
+        return 1;
+    }
+    bool program = !strcmp(argv[1], "prog");
+    bool columns = !strcmp(argv[1], "cols");
+
+    struct Gen_Params params;
+    gen_default_params(&params);
+    long val = 0;
+    int opt = 0;
+    optind = 2;
+    while ((opt = getopt(argc, argv, "n:d:f:o:v:s:")) != -1) {
+        if (opt == 'o') {
+            if (!*optarg) {
+                fprintf(stderr, "Empty operation mix: expected some of '+-*/^scl'\n");
+                return 1;
+            }
+            for (char *op = optarg; *op; op++) {
+                if (!strchr("+-*/^scl", *op)) {
+                    fprintf(stderr, "Unknown operation %c\n", *op);
+                    return 1;
+                }
+            }
+            params.ops = optarg;
+            continue;
+        }
+        if (opt == '?' || read_positive(optarg, &val)) {
+            usage(argv[0]);
+            return 1;
+        }
+        switch (opt) {
+            case 'n':
+                params.nodes = val;
+                break;
+            case 'd':
+                params.depth = val;
+                break;
+            case 'f':
+                if (val < 2) {
+                    fprintf(stderr, "Wrong fanout %s: expected at least 2\n", optarg);
+                    return 1;
+                }
+                params.fanout = val;
+                break;
+            case 'v':
+                if (val < 1) {
+                    fprintf(stderr, "Wrong number of vars %s: expected positive int\n", optarg);
+                    return 1;
+                }
+                params.vars = val;
+                break;
+            case 's':
+                params.seed = val;
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (columns) {
+        long values = gen_columns(stdout, &params);
+        if (fflush(stdout)) {
+            fprintf(stderr, "Can not write output\n");
+            return 1;
+        }
+        fprintf(stderr, "Generated %ld values\n", values);
+        return 0;
+    }
+    long nodes = program ? gen_program(stdout, &params) : gen_expression(stdout, &params);
+    if (fflush(stdout)) {
+        fprintf(stderr, "Can not write output\n");
+        return 1;
+    }
+    fprintf(stderr, "Generated %ld nodes\n", nodes);
+    return 0;
+}
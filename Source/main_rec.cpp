@@ -9,6 +9,13 @@
 
 #include "tree.h"
 #include "visualize.h"
+#include "in_and_out.h"
+#include "stats.h"
+#include "trace.h"
+#include "render.h"
+#include "render_cache.h"
+#include "html_view.h"
+#include "parse_cache.h"
 
 int
 main(int argc, char **argv) {
@@ -16,6 +23,36 @@ main(int argc, char **argv) {
         fprintf(stderr, "No input file or no show parameter\n");
         return -1;
     }
+
+    bool stats = false;
+    char *stats_file = NULL;
+    char *trace_file = NULL;
+    bool html = false;
+    for (int i = 3; i < argc; i++) {
+        char *value = NULL;
+        if (match_option(argv[i], "--stats", &value)) { // --stats or --stats=file.json
+            stats = true;
+            stats_file = value;
+        } else if (match_option(argv[i], "--trace", &value) && value) {
+            trace_enabled = true;
+            trace_file = value;
+        } else if (match_option(argv[i], "--html", &value) && !value) {
+            html = true;
+        } else if (match_option(argv[i], "--parse-cache", &value)) { // --parse-cache or --parse-cache=dir
+            if (parse_cache_open(value, PARSE_CACHE_MAX_BYTES)) {
+                return -1;
+            }
+        } else if (match_option(argv[i], "--render-cache", &value)) { // --render-cache or --render-cache=dir
+            if (render_cache_open(value, RENDER_CACHE_MAX_BYTES)) {
+                return -1;
+            }
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return -1;
+        }
+    }
+    long long total_start = stats_begin(PHASE_TOTAL);
+    long long start = stats_begin(PHASE_PARSE);
     
     int fd = open(argv[1], O_RDONLY);
     if (fd < 0) {
@@ -42,7 +79,16 @@ main(int argc, char **argv) {
     close(fd);
 
     expr_str[str_size - 1] = '$';
-    Node *val = Parse_All(expr_str, str_size);
+    char *cache_entry = NULL;
+    Node *val = parse_cache_load(expr_str, str_size, &cache_entry);
+    if (!val) {
+        val = Parse_All(expr_str, str_size);
+        if (cache_entry) {
+            parse_cache_store(cache_entry, val);
+        }
+    }
+    free(cache_entry);
+    stats_add_time(PHASE_PARSE, start);
 
     errno = 0;
     int show = strtol(argv[2], NULL, 10);
@@ -50,10 +96,25 @@ main(int argc, char **argv) {
         fprintf(stderr, "Please, specify second param as 0 or 1 to show or not show result\n");
         show = 0;
     }
-    create_png(argv[1], val, show);
-    create_pdf(argv[1], val, 0);
+    render_jobs(sysconf(_SC_NPROCESSORS_ONLN)); // dot and pdftex run at the same time
+    if (html) { // huge programs: no dot layout and no pdf
+        create_html(argv[1], val);
+    } else {
+        create_png(argv[1], val, show);
+        create_pdf(argv[1], val, 0);
+    }
 
     rec_del(val);
+    render_wait();
+    render_cache_close();
+    parse_cache_close();
 
+    stats_add_time(PHASE_TOTAL, total_start);
+    if (stats) {
+        stats_write(stats_file, "rec_desc", argv[1]);
+    }
+    if (trace_enabled) {
+        trace_write(trace_file);
+    }
     return 0;
 }
@@ -0,0 +1,120 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "tree.h"
+#include "parse_cache.h"
+#include "disk_cache.h"
+#include "bin_tree.h"
+#include "stats.h"
+
+//! \brief Directory with parsed programs in binary format (bin_tree.h),
+//! named by hash of their source, the parser and the format version
+struct Parse_Cache {
+    char *dir;
+    long max_bytes;
+    char *identity;     // path, size and time of modification of this program
+    char version[32];
+};
+
+static struct Parse_Cache *parse_cache = NULL;
+
+//! \brief Start using parse cache
+//! \param [in] dir Directory of the cache, NULL for the default one
+//! \param [in] max_bytes Size of the cache, checked by parse_cache_close
+//! \return Returns 0 in success -1 else
+int
+parse_cache_open(const char *dir, long max_bytes) {
+    char exe[PATH_MAX + 1] = {};
+    if (readlink("/proc/self/exe", exe, PATH_MAX) <= 0) {
+        fprintf(stderr, "Can not find the program file for parse cache\n");
+        return -1;
+    }
+    char *path = disk_cache_dir(dir, PARSE_CACHE_DIR);
+    if (!path) {
+        return -1;
+    }
+    parse_cache = (struct Parse_Cache *)calloc(1, sizeof(*parse_cache));
+    if (!parse_cache) {
+        fprintf(stderr, "Can not allocate memory\n");
+        free(path);
+        return -1;
+    }
+    parse_cache->dir = path;
+    parse_cache->max_bytes = max_bytes;
+    parse_cache->identity = disk_cache_identity(exe); // new parser is a new program
+    snprintf(parse_cache->version, sizeof(parse_cache->version), "bin %u", BIN_VERSION);
+    return 0;
+}
+
+//! \brief Stop using parse cache, its size is bounded here
+void
+parse_cache_close() {
+    if (!parse_cache) {
+        return;
+    }
+    disk_cache_evict(parse_cache->dir, parse_cache->max_bytes, PARSE_CACHE_EVICTED);
+    free(parse_cache->identity);
+    free(parse_cache->dir);
+    free(parse_cache);
+    parse_cache = NULL;
+}
+
+//! \brief Take parsed tree of the source from the cache: the cached file is
+//! mmaped and the tree is built from it without lexing and parsing. Changed
+//! source has other name, so old entries are never used and are evicted later
+//! \param [in] text Source
+//! \param [in] size Size of text
+//! \param [out] entry Allocated name of the entry for parse_cache_store or NULL, if cache is not used
+//! \return Returns tree or NULL, if it must be parsed
+Node *
+parse_cache_load(const char *text, long size, char **entry) {
+    *entry = NULL;
+    if (!parse_cache || !parse_cache->identity) {
+        return NULL;
+    }
+    const char *keys[] = {parse_cache->identity, parse_cache->version};
+    *entry = disk_cache_entry(parse_cache->dir, keys, 2, text, size, ".bin");
+    if (!*entry || access(*entry, R_OK)) {
+        STAT_INC(PARSE_CACHE_MISSES);
+        return NULL;
+    }
+    struct Bin_Tree *bin = load_bin_tree(*entry);
+    if (!bin) {
+        unlink(*entry); // broken entry is written again
+        STAT_INC(PARSE_CACHE_MISSES);
+        return NULL;
+    }
+    Node *root = bin_build_tree(bin, 0);
+    unload_bin_tree(bin);
+    utimensat(AT_FDCWD, *entry, NULL, 0);
+    STAT_INC(PARSE_CACHE_HITS);
+    return root;
+}
+
+//! \brief Save parsed tree into the cache. Entry is written into temporary
+//! file and renamed, so readers never see a part of it
+//! \param [in] entry Cached file (parse_cache_load)
+//! \param [in] root Parsed tree
+//! \return Returns 0 in success -1 else
+int
+parse_cache_store(const char *entry, Node *root) {
+    if (!entry || !root) {
+        return -1;
+    }
+    std::string tmp = std::string(entry) + "." + std::to_string(getpid()) + ".tmp";
+    if (save_bin_tree((char *)tmp.c_str(), root)) {
+        unlink(tmp.c_str());
+        return -1;
+    }
+    if (rename(tmp.c_str(), entry)) {
+        unlink(tmp.c_str());
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,298 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "tree.h"
+#include "plot.h"
+#include "cse.h"
+#include "stats.h"
+#include "symbols.h"
+#include "visualize.h"
+
+//! \brief Number of plotted functions: expression and its derivate
+constexpr int PLOT_FUNCS = 2;
+
+struct Plot_Point {
+    double x;
+    double y[PLOT_FUNCS];
+};
+
+//! \brief Interval to refine: its ends are already calculated
+struct Plot_Interval {
+    struct Plot_Point left;
+    struct Plot_Point right;
+    int depth;
+};
+
+//! \brief Functions to evaluate, shared by all threads (read only)
+struct Plot_Funcs {
+    struct Cse_Dag *dags[PLOT_FUNCS];
+    int var_id;
+};
+
+//! \brief Calculate functions in points [begin, end), every thread has its own scratch
+static void
+eval_chunk(struct Plot_Funcs *funcs, struct Plot_Point *points, int begin, int end) {
+    std::vector<double> values(funcs->var_id + 1, 0);
+    std::vector<double> temps[PLOT_FUNCS];
+    for (int f = 0; f < PLOT_FUNCS; f++) {
+        temps[f].resize(cse_nodes_number(funcs->dags[f]));
+    }
+    for (int i = begin; i < end; i++) {
+        values[funcs->var_id] = points[i].x;
+        for (int f = 0; f < PLOT_FUNCS; f++) {
+            points[i].y[f] = cse_eval_temps(funcs->dags[f], values.data(), values.size(), temps[f].data());
+        }
+    }
+}
+
+//! \brief Calculate functions in all points, split into equal chunks between threads
+static void
+eval_points(struct Plot_Funcs *funcs, std::vector<struct Plot_Point> *points, int threads) {
+    int size = points->size();
+    threads = std::max(1, std::min(threads, size / PLOT_MIN_POINTS_PER_THREAD));
+    int chunk = (size + threads - 1) / threads;
+    std::vector<std::thread> pool;
+    for (int t = 1; t < threads; t++) {
+        pool.push_back(std::thread(eval_chunk, funcs, points->data(), t * chunk, std::min(size, (t + 1) * chunk)));
+    }
+    eval_chunk(funcs, points->data(), 0, std::min(size, chunk));
+    for (size_t t = 0; t < pool.size(); t++) {
+        pool[t].join();
+    }
+    STAT_ADD(PLOT_POINTS, size);
+}
+
+//! \brief Check, if the middle point is far from the chord of the interval
+//! (curvature is visible) or the interval contains border of the domain
+static bool
+need_split(struct Plot_Interval *interval, struct Plot_Point *mid, double *scales) {
+    for (int f = 0; f < PLOT_FUNCS; f++) {
+        double left = interval->left.y[f];
+        double right = interval->right.y[f];
+        int finite = std::isfinite(left) + std::isfinite(right) + std::isfinite(mid->y[f]);
+        if (finite == 3 && fabs(mid->y[f] - (left + right) / 2) > PLOT_TOLERANCE * scales[f]) {
+            return true;
+        }
+        if (finite && finite != 3) {
+            return true;
+        }
+    }
+    return false;
+}
+
+//! \brief Sample functions adaptively: uniform grid, then intervals are
+//! halved while they are curved. Every round calculates all new middle
+//! points in parallel.
+static void
+sample(struct Plot_Funcs *funcs, double from, double to, int threads, std::vector<struct Plot_Point> *res) {
+    res->resize(PLOT_INITIAL_POINTS + 1);
+    for (int i = 0; i <= PLOT_INITIAL_POINTS; i++) {
+        (*res)[i].x = from + (to - from) * i / PLOT_INITIAL_POINTS;
+    }
+    eval_points(funcs, res, threads);
+
+    double scales[PLOT_FUNCS];
+    for (int f = 0; f < PLOT_FUNCS; f++) {
+        double min = INFINITY, max = -INFINITY;
+        for (size_t i = 0; i < res->size(); i++) {
+            if (std::isfinite((*res)[i].y[f])) {
+                min = std::min(min, (*res)[i].y[f]);
+                max = std::max(max, (*res)[i].y[f]);
+            }
+        }
+        scales[f] = (max > min) ? max - min : 1;
+    }
+
+    std::vector<struct Plot_Interval> pending, next;
+    for (int i = 0; i < PLOT_INITIAL_POINTS; i++) {
+        pending.push_back({(*res)[i], (*res)[i + 1], 0});
+    }
+    std::vector<struct Plot_Point> mids;
+    while (!pending.empty()) {
+        mids.resize(pending.size());
+        for (size_t i = 0; i < pending.size(); i++) {
+            mids[i].x = (pending[i].left.x + pending[i].right.x) / 2;
+        }
+        eval_points(funcs, &mids, threads);
+        next.clear();
+        for (size_t i = 0; i < pending.size(); i++) {
+            res->push_back(mids[i]);
+            if (pending[i].depth < PLOT_MAX_DEPTH && need_split(&pending[i], &mids[i], scales)) {
+                next.push_back({pending[i].left, mids[i], pending[i].depth + 1});
+                next.push_back({mids[i], pending[i].right, pending[i].depth + 1});
+            }
+        }
+        pending.swap(next);
+    }
+    std::sort(res->begin(), res->end(), [](const struct Plot_Point &first, const struct Plot_Point &second) {
+        return first.x < second.x;
+    });
+}
+
+//! \brief Range of values to show: spikes near poles are cut off by quantiles
+static void
+value_range(std::vector<struct Plot_Point> &points, double *min, double *max) {
+    std::vector<double> values;
+    for (size_t i = 0; i < points.size(); i++) {
+        for (int f = 0; f < PLOT_FUNCS; f++) {
+            if (std::isfinite(points[i].y[f])) {
+                values.push_back(points[i].y[f]);
+            }
+        }
+    }
+    if (values.empty()) {
+        *min = -1;
+        *max = 1;
+        return;
+    }
+    std::sort(values.begin(), values.end());
+    *min = values[values.size() / 100];
+    *max = values[values.size() - 1 - values.size() / 100];
+    double pad = (*max - *min) * 0.05;
+    if (pad <= 0) {
+        pad = 1;
+    }
+    *min -= pad;
+    *max += pad;
+}
+
+//! \brief Write curves, axes and labels in svg format
+//! \param [in] order Order of the plotted derivate, for its label
+static void
+write_svg(int fd, std::vector<struct Plot_Point> &points, double from, double to, int order) {
+    double min = 0, max = 0;
+    value_range(points, &min, &max);
+    double x_scale = (PLOT_WIDTH - 2 * PLOT_MARGIN) / (to - from);
+    double y_scale = (PLOT_HEIGHT - 2 * PLOT_MARGIN) / (max - min);
+    auto px = [&](double x) { return PLOT_MARGIN + (x - from) * x_scale; };
+    auto py = [&](double y) { return PLOT_HEIGHT - PLOT_MARGIN - (y - min) * y_scale; };
+
+    dprintf(fd, "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%d\" height=\"%d\" viewBox=\"0 0 %d %d\">\n",
+            PLOT_WIDTH, PLOT_HEIGHT, PLOT_WIDTH, PLOT_HEIGHT);
+    dprintf(fd, "<rect width=\"100%%\" height=\"100%%\" fill=\"white\"/>\n");
+    if (min < 0 && max > 0) {
+        dprintf(fd, "<line x1=\"%d\" y1=\"%.2f\" x2=\"%d\" y2=\"%.2f\" stroke=\"grey\"/>\n",
+                PLOT_MARGIN, py(0), PLOT_WIDTH - PLOT_MARGIN, py(0));
+    }
+    if (from < 0 && to > 0) {
+        dprintf(fd, "<line x1=\"%.2f\" y1=\"%d\" x2=\"%.2f\" y2=\"%d\" stroke=\"grey\"/>\n",
+                px(0), PLOT_MARGIN, px(0), PLOT_HEIGHT - PLOT_MARGIN);
+    }
+    dprintf(fd, "<rect x=\"%d\" y=\"%d\" width=\"%d\" height=\"%d\" fill=\"none\" stroke=\"black\"/>\n",
+            PLOT_MARGIN, PLOT_MARGIN, PLOT_WIDTH - 2 * PLOT_MARGIN, PLOT_HEIGHT - 2 * PLOT_MARGIN);
+    dprintf(fd, "<clipPath id=\"area\"><rect x=\"%d\" y=\"%d\" width=\"%d\" height=\"%d\"/></clipPath>\n",
+            PLOT_MARGIN, PLOT_MARGIN, PLOT_WIDTH - 2 * PLOT_MARGIN, PLOT_HEIGHT - 2 * PLOT_MARGIN);
+
+    const char *colors[PLOT_FUNCS] = {"blue", "red"};
+    char der_name[32];
+    if (order <= 3) {
+        snprintf(der_name, sizeof(der_name), "f%.*s(x)", order, "'''");
+    } else {
+        snprintf(der_name, sizeof(der_name), "f^(%d)(x)", order);
+    }
+    const char *names[PLOT_FUNCS] = {"f(x)", der_name};
+    for (int f = 0; f < PLOT_FUNCS; f++) {
+        bool open = false;
+        for (size_t i = 0; i < points.size(); i++) {
+            double y = points[i].y[f];
+            // far points would overflow coordinates of viewer, curve is broken there
+            if (!std::isfinite(y) || py(y) < -PLOT_HEIGHT || py(y) > 2 * PLOT_HEIGHT) {
+                if (open) {
+                    dprintf(fd, "\"/>\n");
+                    open = false;
+                }
+                continue;
+            }
+            if (!open) {
+                dprintf(fd, "<polyline clip-path=\"url(#area)\" fill=\"none\" stroke=\"%s\" points=\"", colors[f]);
+                open = true;
+            }
+            dprintf(fd, "%.2f,%.2f ", px(points[i].x), py(y));
+        }
+        if (open) {
+            dprintf(fd, "\"/>\n");
+        }
+        dprintf(fd, "<text x=\"%d\" y=\"%d\" fill=\"%s\">%s</text>\n",
+                PLOT_WIDTH - PLOT_MARGIN - 60, PLOT_MARGIN - 20 + 15 * f, colors[f], names[f]);
+    }
+    dprintf(fd, "<text x=\"%d\" y=\"%d\">%g</text>\n", PLOT_MARGIN, PLOT_HEIGHT - PLOT_MARGIN + 15, from);
+    dprintf(fd, "<text x=\"%d\" y=\"%d\" text-anchor=\"end\">%g</text>\n",
+            PLOT_WIDTH - PLOT_MARGIN, PLOT_HEIGHT - PLOT_MARGIN + 15, to);
+    dprintf(fd, "<text x=\"%d\" y=\"%d\" text-anchor=\"end\">%.4g</text>\n", PLOT_MARGIN - 2, PLOT_MARGIN + 5, max);
+    dprintf(fd, "<text x=\"%d\" y=\"%d\" text-anchor=\"end\">%.4g</text>\n",
+            PLOT_MARGIN - 2, PLOT_HEIGHT - PLOT_MARGIN, min);
+    dprintf(fd, "</svg>\n");
+}
+
+//! \brief Check, that the variable is the only one in the tree
+static bool
+only_var(Node *node, int var_id) {
+    if (node->get_operation() == VAR && node->get_name_id() != var_id) {
+        fprintf(stderr, "Can not plot expression with variable %s\n", node->get_name());
+        return false;
+    }
+    for (int i = 0; i < node->get_children_number(); i++) {
+        if (!only_var(node->get_childs()[i], var_id)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//! \brief Plot the expression and its derivate into svg file
+//! \param [in] filename Name of svg file
+//! \param [in] func Expression
+//! \param [in] der Derivate of the expression
+//! \param [in] order Order of the derivate
+//! \param [in] var_id Symbol id of the variable
+//! \param [in] from,to Range of the variable
+//! \param [in] threads Number of threads to calculate values
+//! \return Returns 0 in success 1 else
+int
+plot_svg(char *filename, Node *func, Node *der, int order, int var_id, double from, double to, int threads) {
+    if (!func || !der || !only_var(func, var_id) || !only_var(der, var_id)) {
+        return 1;
+    }
+    long long start = stats_begin(PHASE_PLOT);
+    struct Plot_Funcs funcs = {{cse_build(func), cse_build(der)}, var_id};
+    std::vector<struct Plot_Point> points;
+    sample(&funcs, from, to, threads, &points);
+    cse_free(funcs.dags[0]);
+    cse_free(funcs.dags[1]);
+
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, out_mode);
+    if (fd < 0) {
+        fprintf(stderr, "Can not open out file %s\n", filename);
+        stats_add_time(PHASE_PLOT, start);
+        return 1;
+    }
+    write_svg(fd, points, from, to, order);
+    STAT_ADD(BYTES_WRITTEN, lseek(fd, 0, SEEK_CUR));
+    close(fd);
+    stats_add_time(PHASE_PLOT, start);
+    return 0;
+}
+
+//! \brief Parse range of plot 'from:to'
+//! \return Returns 0 in success -1 else
+int
+parse_plot_range(const char *str, double *from, double *to) {
+    char *end = NULL;
+    *from = strtod(str, &end);
+    if (*end != ':') {
+        return -1;
+    }
+    *to = strtod(end + 1, &end);
+    if (*end || !(*from < *to)) {
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,395 @@
+#include <cstdio>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+
+#include "tree.h"
+#include "poly.h"
+#include "stats.h"
+#include "symbols.h"
+
+//! \brief Exponent of every variable (by variable index), without trailing zeros
+typedef std::vector<int> Monomial;
+
+struct Monomial_Hash {
+    size_t operator()(const Monomial &mono) const {
+        size_t hash = 0;
+        for (size_t i = 0; i < mono.size(); i++) {
+            hash = hash * 1000003ULL ^ mono[i];
+        }
+        return hash;
+    }
+};
+
+//! \brief Sparse polynomial: monomial -> coefficient
+typedef std::unordered_map<Monomial, double, Monomial_Hash> Poly;
+
+//! \brief Symbols of one conversion: variables and not polynomial subtrees (atoms)
+struct Poly_Context {
+    std::vector<int> vars;          // symbol id of variable, SYMBOL_NONE for atom
+    std::vector<Node *> atoms;      // subtree for atom, NULL for variable
+    std::unordered_map<int, int> var_ids;
+    std::unordered_multimap<unsigned long long, int> atom_ids; // tree_hash of atom -> symbol
+    std::unordered_set<Node *> *failed; // operations, which are not polynomials, their operands are normalized
+};
+
+static Monomial
+mono_mul(const Monomial &first, const Monomial &second) {
+    Monomial res(std::max(first.size(), second.size()), 0);
+    for (size_t i = 0; i < first.size(); i++) {
+        res[i] += first[i];
+    }
+    for (size_t i = 0; i < second.size(); i++) {
+        res[i] += second[i];
+    }
+    return res; // no trailing zeros, as exponents are not negative
+}
+
+//! \brief res += sign * other
+static void
+poly_add(Poly *res, Poly &other, double sign) {
+    for (auto it = other.begin(); it != other.end(); ++it) {
+        (*res)[it->first] += sign * it->second;
+    }
+}
+
+//! \brief Product of polynomials
+//! \return Returns false, if product of two sums has too many terms (expansion
+//! would make the tree bigger, so such product stays an atom)
+static bool
+poly_mul(Poly *res, Poly &first, Poly &second) {
+    if (first.size() > 1 && second.size() > 1 && (long)(first.size() * second.size()) > POLY_MAX_EXPAND) {
+        return false;
+    }
+    res->clear();
+    for (auto it1 = first.begin(); it1 != first.end(); ++it1) {
+        for (auto it2 = second.begin(); it2 != second.end(); ++it2) {
+            (*res)[mono_mul(it1->first, it2->first)] += it1->second * it2->second;
+        }
+    }
+    return true;
+}
+
+//! \brief Check, if polynomial is a constant
+//! \param [in] poly Polynomial
+//! \param [out] value Value of the constant
+static bool
+poly_constant(Poly &poly, double *value) {
+    *value = 0;
+    for (auto it = poly.begin(); it != poly.end(); ++it) {
+        if (!it->first.empty() && !is_eq(it->second, 0)) {
+            return false;
+        }
+        if (it->first.empty()) {
+            *value = it->second;
+        }
+    }
+    return true;
+}
+
+//! \brief Polynomial of one symbol
+static void
+symbol_poly(int symbol, Poly *res) {
+    Monomial mono(symbol + 1, 0);
+    mono[symbol] = 1;
+    res->clear();
+    (*res)[mono] = 1;
+}
+
+//! \brief Make subtree an atom: it is treated as a separate variable, equal
+//! subtrees are the same atom, so their terms are collected
+static void
+atom_poly(struct Poly_Context *ctx, Node *node, Poly *res) {
+    unsigned long long hash = tree_hash(node);
+    auto range = ctx->atom_ids.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        // symbols of failed conversions are forgotten, their ids may be reused
+        int id = it->second;
+        if (id < (int)ctx->atoms.size() && ctx->atoms[id] && tree_same(ctx->atoms[id], node)) {
+            symbol_poly(id, res);
+            return;
+        }
+    }
+    ctx->atom_ids.emplace(hash, ctx->atoms.size());
+    ctx->vars.push_back(SYMBOL_NONE);
+    ctx->atoms.push_back(node);
+    symbol_poly(ctx->atoms.size() - 1, res);
+}
+
+//! \brief Check, if operation can be a part of polynomial
+bool
+is_poly_operation(int operation) {
+    return operation == ADD || operation == SUB || operation == MUL || operation == DIV || operation == POWER;
+}
+
+//! \brief Convert operation node into polynomial
+//! \return Returns false, if node is not a polynomial of its children
+static bool
+operation_to_poly(struct Poly_Context *ctx, Node *node, Poly *res);
+
+//! \brief poly_normalize, which knows operations, that are not polynomials
+static bool
+normalize(Node *node, std::unordered_set<Node *> *failed);
+
+//! \brief Convert tree into polynomial. N-ary operations are left folded, as in get_val.
+//! Subtrees, which are not polynomials (sin, x ^ y, ...), become atoms
+//! \param [in] ctx Symbols
+//! \param [in] node Tree
+//! \param [out] res Polynomial
+static void
+to_poly(struct Poly_Context *ctx, Node *node, Poly *res) {
+    res->clear();
+    if (node->get_operation() == CONSTANT) {
+        (*res)[Monomial()] = node->get_value();
+        return;
+    }
+    if (node->get_operation() == VAR) {
+        int name = node->get_name_id();
+        auto found = ctx->var_ids.find(name);
+        if (found == ctx->var_ids.end()) {
+            found = ctx->var_ids.emplace(name, ctx->vars.size()).first;
+            ctx->vars.push_back(name);
+            ctx->atoms.push_back(NULL);
+        }
+        symbol_poly(found->second, res);
+        return;
+    }
+    // a failed operation fails in every context, so it is converted and its
+    // operands are normalized once
+    if (!is_poly_operation(node->get_operation()) || ctx->failed->count(node)) {
+        atom_poly(ctx, node, res);
+        return;
+    }
+    size_t symbols = ctx->vars.size();
+    if (operation_to_poly(ctx, node, res)) {
+        return;
+    }
+    // forget symbols of the failed conversion, then operands are normalized separately
+    for (size_t i = symbols; i < ctx->vars.size(); i++) {
+        if (!ctx->atoms[i]) {
+            ctx->var_ids.erase(ctx->vars[i]);
+        }
+    }
+    ctx->vars.resize(symbols);
+    ctx->atoms.resize(symbols);
+    ctx->failed->insert(node);
+    for (int i = 0; i < node->get_children_number(); i++) {
+        if (is_poly_operation(node->get_childs()[i]->get_operation())) {
+            normalize(node->get_childs()[i], ctx->failed);
+        }
+    }
+    atom_poly(ctx, node, res);
+}
+
+static bool
+operation_to_poly(struct Poly_Context *ctx, Node *node, Poly *res) {
+    int operation = node->get_operation();
+    Node **childs = node->get_childs();
+    if (operation == POWER && node->get_children_number() != 2) {
+        return false;
+    }
+    to_poly(ctx, childs[0], res);
+    Poly operand, tmp;
+    for (int i = 1; i < node->get_children_number(); i++) {
+        to_poly(ctx, childs[i], &operand);
+        double value = 0;
+        switch (operation) {
+            case ADD:
+                poly_add(res, operand, 1);
+                break;
+            case SUB:
+                poly_add(res, operand, -1);
+                break;
+            case MUL:
+                if (!poly_mul(&tmp, *res, operand)) {
+                    return false;
+                }
+                res->swap(tmp);
+                break;
+            case DIV:
+                if (!poly_constant(operand, &value) || is_eq(value, 0)) {
+                    return false;
+                }
+                for (auto it = res->begin(); it != res->end(); ++it) {
+                    it->second /= value;
+                }
+                break;
+            default: // POWER
+                if (!poly_constant(operand, &value) || value < 0 || value > POLY_MAX_POWER ||
+                    !is_eq(value, round(value))) {
+                    return false;
+                }
+                operand.swap(*res);
+                res->clear();
+                (*res)[Monomial()] = 1;
+                for (int j = 0; j < (int)round(value); j++) {
+                    if (!poly_mul(&tmp, *res, operand)) {
+                        return false;
+                    }
+                    res->swap(tmp);
+                }
+                break;
+        }
+    }
+    return true;
+}
+
+//! \brief Order of terms in the result: lower total degree first, then by symbols
+struct Term_Order {
+    std::vector<int> *order; // symbol indexes: variables sorted by name, then atoms
+    bool operator()(const std::pair<Monomial, double> &first, const std::pair<Monomial, double> &second) const {
+        int degree1 = 0, degree2 = 0;
+        for (size_t i = 0; i < first.first.size(); i++) {
+            degree1 += first.first[i];
+        }
+        for (size_t i = 0; i < second.first.size(); i++) {
+            degree2 += second.first[i];
+        }
+        if (degree1 != degree2) {
+            return degree1 < degree2;
+        }
+        for (size_t i = 0; i < order->size(); i++) {
+            int var = (*order)[i];
+            int exp1 = var < (int)first.first.size() ? first.first[var] : 0;
+            int exp2 = var < (int)second.first.size() ? second.first[var] : 0;
+            if (exp1 != exp2) {
+                return exp1 > exp2;
+            }
+        }
+        return false;
+    }
+};
+
+//! \brief Build tree of one term: coef * x * y ^ 2
+static Node *
+term_to_node(struct Poly_Context *ctx, std::vector<int> &order, const Monomial &mono, double coef) {
+    Node *res = new Node(MUL);
+    if (mono.empty() || !is_eq(coef, 1)) {
+        res->add_child(new Node(coef));
+    }
+    for (size_t i = 0; i < order.size(); i++) {
+        int var = order[i];
+        if (var >= (int)mono.size() || !mono[var]) {
+            continue;
+        }
+        Node *factor = NULL;
+        if (ctx->atoms[var]) {
+            factor = ctx->atoms[var]->copy();
+        } else {
+            factor = new Node(VAR, ctx->vars[var]);
+        }
+        if (mono[var] > 1) {
+            Node *power = new Node(POWER);
+            power->add_child(factor);
+            power->add_child(new Node((double)mono[var]));
+            factor = power;
+        }
+        res->add_child(factor);
+    }
+    if (res->get_children_number() == 1) {
+        Node *single = res->cut_child(0);
+        delete res;
+        return single;
+    }
+    return res;
+}
+
+//! \brief Convert polynomial back to tree, terms are sorted
+static Node *
+poly_to_node(struct Poly_Context *ctx, Poly &poly) {
+    std::vector<std::pair<Monomial, double>> terms;
+    for (auto it = poly.begin(); it != poly.end(); ++it) {
+        if (!is_eq(it->second, 0)) {
+            terms.push_back(*it);
+        }
+    }
+    if (terms.empty()) {
+        return new Node(0.0);
+    }
+    std::vector<int> order(ctx->vars.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [ctx](int first, int second) {
+        if ((ctx->atoms[first] == NULL) != (ctx->atoms[second] == NULL)) {
+            return ctx->atoms[first] == NULL;
+        }
+        if (ctx->vars[first] != ctx->vars[second]) {
+            return strcmp(symbol_name(ctx->vars[first]), symbol_name(ctx->vars[second])) < 0;
+        }
+        return first < second;
+    });
+    struct Term_Order cmp = {&order};
+    std::sort(terms.begin(), terms.end(), cmp);
+    if (terms.size() == 1) {
+        return term_to_node(ctx, order, terms[0].first, terms[0].second);
+    }
+    Node *res = new Node(ADD);
+    for (size_t i = 0; i < terms.size(); i++) {
+        res->add_child(term_to_node(ctx, order, terms[i].first, terms[i].second));
+    }
+    return res;
+}
+
+//! \brief Number of nodes in the tree, which poly_to_node would build
+static long
+poly_size(struct Poly_Context *ctx, Poly &poly) {
+    std::vector<long> atom_sizes(ctx->atoms.size(), 0);
+    long res = 0;
+    long terms = 0;
+    for (auto it = poly.begin(); it != poly.end(); ++it) {
+        if (is_eq(it->second, 0)) {
+            continue;
+        }
+        const Monomial &mono = it->first;
+        long children = (mono.empty() || !is_eq(it->second, 1)) ? 1 : 0;
+        long size = children;
+        for (size_t i = 0; i < mono.size(); i++) {
+            if (!mono[i]) {
+                continue;
+            }
+            if (ctx->atoms[i] && !atom_sizes[i]) {
+                atom_sizes[i] = ctx->atoms[i]->get_size();
+            }
+            children++;
+            size += (ctx->atoms[i] ? atom_sizes[i] : 1) + (mono[i] > 1 ? 2 : 0);
+        }
+        res += size + (children > 1 ? 1 : 0);
+        terms++;
+    }
+    if (!terms) {
+        return 1;
+    }
+    return res + (terms > 1 ? 1 : 0);
+}
+
+static bool
+normalize(Node *node, std::unordered_set<Node *> *failed) {
+    struct Poly_Context ctx;
+    ctx.failed = failed;
+    Poly poly;
+    to_poly(&ctx, node, &poly);
+    if (ctx.vars.empty() || (ctx.atoms.size() == 1 && ctx.atoms[0] == node)) {
+        return false;
+    }
+    if (poly_size(&ctx, poly) >= node->get_size()) {
+        return false;
+    }
+    node->replace_by(poly_to_node(&ctx, poly));
+    STAT_INC(RULE_POLY_NORMAL_FORM);
+    return true;
+}
+
+//! \brief Collect like terms of polynomial subtree: convert it into
+//! sparse monomial -> coefficient form and back.
+//! \param [in] node Root of the subtree
+//! \return Returns true, if subtree was replaced (it is not a constant
+//! and the normal form is smaller)
+bool
+poly_normalize(Node *node) {
+    std::unordered_set<Node *> failed;
+    return normalize(node, &failed);
+}
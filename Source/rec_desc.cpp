@@ -4,6 +4,7 @@
 #include <cstring>
 
 #include "tree.h"
+#include "symbols.h"
 
 #define REQUIRE(a, env) \
     { if ((env)->current_ind >= (env)->str_size) (env)->error = NO_SYMBOL;\
@@ -103,11 +104,9 @@ GetId(struct Env *env) {
     }
 
     int id_length = 1;
-    char *id = (char *)calloc(ID_NAME_SIZE + 1, sizeof(char));
-    id[0] = env->str[env->current_ind];
+    const char *id = env->str + env->current_ind;
     env->current_ind++;
     while(isalnum(env->str[env->current_ind])) {
-        id[id_length] = env->str[env->current_ind];
         env->current_ind++;
         id_length++;
         if (id_length > ID_NAME_SIZE) {
@@ -116,9 +115,7 @@ GetId(struct Env *env) {
         }
     }
 
-    Node *root = new Node(VAR, id);
-    free(id);
-    return root;
+    return new Node(VAR, intern_symbol(id, id_length));
 }
 
 
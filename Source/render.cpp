@@ -0,0 +1,312 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <spawn.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "render.h"
+#include "render_cache.h"
+#include "stats.h"
+
+extern char **environ;
+
+//! \brief External renderer (dot, pdftex, viewer), running without shell
+struct Render_Job {
+    pid_t pid;              // 0 for free slot
+    int phase;
+    long long start;
+    char *input;            // mmaped source, written into stdin of the process
+    long input_size;
+    long written;
+    int input_fd;           // write end of the stdin pipe, -1 if closed
+    char *argv[RENDER_MAX_ARGS + 1];
+    char *then[RENDER_MAX_ARGS + 1];    // started in the same slot, when this one succeeds
+    int then_phase;
+    char *output;           // saved as cache_entry, when the process succeeds
+    char *cache_entry;
+};
+
+static struct Render_Job render_slots[RENDER_MAX_JOBS];
+static int render_limit = 1;
+static int render_running = 0;
+static int render_failed = 0;
+
+//! \brief Set number of processes in flight
+//! \param [in] jobs Number of processes, 1 to run them one by one
+void
+render_jobs(int jobs) {
+    render_limit = (jobs < 1) ? 1 : (jobs > RENDER_MAX_JOBS) ? RENDER_MAX_JOBS : jobs;
+}
+
+//! \brief Free copied arguments
+static void
+free_args(char **args) {
+    for (int i = 0; args[i]; i++) {
+        free(args[i]);
+        args[i] = NULL;
+    }
+}
+
+//! \brief Copy NULL terminated arguments, so callers may pass temporary strings
+//! \return Returns 0 in success -1 else
+static int
+copy_args(char **dst, const char *const *src) {
+    for (int i = 0; src && src[i]; i++) {
+        if (i == RENDER_MAX_ARGS) {
+            fprintf(stderr, "Too many arguments of %s\n", src[0]);
+            free_args(dst);
+            return -1;
+        }
+        dst[i] = strdup(src[i]);
+        if (!dst[i]) {
+            fprintf(stderr, "Memory allocation error\n");
+            free_args(dst);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+//! \brief Close stdin pipe of the process and release its source
+static void
+close_input(struct Render_Job *job) {
+    if (job->input_fd >= 0) {
+        close(job->input_fd);
+        job->input_fd = -1;
+    }
+    if (job->input) {
+        munmap(job->input, job->input_size);
+        job->input = NULL;
+    }
+}
+
+//! \brief Clear slot after the process
+static void
+free_job(struct Render_Job *job) {
+    close_input(job);
+    free_args(job->argv);
+    free_args(job->then);
+    free(job->output);
+    free(job->cache_entry);
+    job->output = NULL;
+    job->cache_entry = NULL;
+    job->pid = 0;
+}
+
+//! \brief Start process of the slot: stdin is the pipe with input or /dev/null,
+//! stdout is /dev/null (renderers write files, only errors are shown)
+//! \return Returns 0 in success -1 else
+static int
+start_job(struct Render_Job *job) {
+    int pipe_fds[2] = {-1, -1};
+    if (job->input && pipe2(pipe_fds, O_CLOEXEC)) {
+        fprintf(stderr, "Can not create pipe for %s\n", job->argv[0]);
+        return -1;
+    }
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if (job->input) {
+        posix_spawn_file_actions_adddup2(&actions, pipe_fds[0], STDIN_FILENO);
+    } else {
+        posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    }
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    job->start = stats_now();
+    int err = posix_spawnp(&job->pid, job->argv[0], &actions, NULL, job->argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (job->input) {
+        close(pipe_fds[0]);
+        job->input_fd = pipe_fds[1];
+    }
+    STAT_INC(SUBPROCESS_CALLS);
+    if (err) {
+        fprintf(stderr, "Can not start %s: %s\n", job->argv[0], strerror(err));
+        STAT_INC(SUBPROCESS_FAILED);
+        job->pid = 0;
+        return -1;
+    }
+    if (job->input_fd >= 0) {
+        fcntl(job->input_fd, F_SETFL, O_NONBLOCK);
+    }
+    render_running++;
+    return 0;
+}
+
+//! \brief Write into stdin pipe as much as it takes without blocking
+static void
+feed_job(struct Render_Job *job) {
+    while (job->input_fd >= 0 && job->written < job->input_size) {
+        long res = write(job->input_fd, job->input + job->written, job->input_size - job->written);
+        if (res < 0) {
+            if (errno == EAGAIN || errno == EINTR) {
+                return;
+            }
+            break; // process does not read, its exit code tells why
+        }
+        job->written += res;
+    }
+    close_input(job);
+}
+
+//! \brief Account finished process, start its next command, if it succeeded
+//! \param [in] job Slot
+//! \param [in] status Status from waitpid
+static void
+finish_job(struct Render_Job *job, int status) {
+    render_running--;
+    stats_add_async(job->phase, job->start, job->pid);
+    if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+        if (WIFEXITED(status)) {
+            fprintf(stderr, "%s failed with exit code %d\n", job->argv[0], WEXITSTATUS(status));
+        } else {
+            fprintf(stderr, "%s was killed by signal %d\n", job->argv[0], WTERMSIG(status));
+        }
+        STAT_INC(SUBPROCESS_FAILED);
+        render_failed++;
+        free_job(job);
+        return;
+    }
+    close_input(job);
+    free_args(job->argv);
+    if (job->cache_entry) {
+        if (render_cache_store(job->output, job->cache_entry)) {
+            fprintf(stderr, "Can not store %s in render cache\n", job->output);
+        }
+        free(job->output);
+        free(job->cache_entry);
+        job->output = NULL;
+        job->cache_entry = NULL;
+    }
+    if (!job->then[0]) {
+        free_job(job);
+        return;
+    }
+    memcpy(job->argv, job->then, sizeof(job->argv));
+    memset(job->then, 0, sizeof(job->then));
+    job->phase = job->then_phase;
+    if (start_job(job)) {
+        render_failed++;
+        free_job(job);
+    }
+}
+
+//! \brief Find slot of the process
+static struct Render_Job *
+find_job(pid_t pid) {
+    for (int i = 0; i < RENDER_MAX_JOBS; i++) {
+        if (render_slots[i].pid == pid) {
+            return &render_slots[i];
+        }
+    }
+    return NULL;
+}
+
+//! \brief Feed pipes and collect finished processes
+//! \param [in] block Wait, until at least one process is finished
+static void
+render_poll(bool block) {
+    while (render_running) {
+        struct pollfd fds[RENDER_MAX_JOBS];
+        int fds_num = 0;
+        int finished = 0;
+        for (int i = 0; i < RENDER_MAX_JOBS; i++) {
+            struct Render_Job *job = &render_slots[i];
+            if (!job->pid) {
+                continue;
+            }
+            feed_job(job);
+            int status = 0;
+            if (waitpid(job->pid, &status, WNOHANG) == job->pid) {
+                finish_job(job, status);
+                finished++;
+            } else if (job->input_fd >= 0) {
+                fds[fds_num].fd = job->input_fd;
+                fds[fds_num].events = POLLOUT;
+                fds_num++;
+            }
+        }
+        if (finished || !block) {
+            return;
+        }
+        if (fds_num) {
+            poll(fds, fds_num, RENDER_POLL_MS);
+            continue;
+        }
+        // nothing to write: sleep until some child exits, it is reaped above
+        siginfo_t info;
+        memset(&info, 0, sizeof(info));
+        if (waitid(P_ALL, 0, &info, WEXITED | WNOWAIT) || !find_job(info.si_pid)) {
+            poll(NULL, 0, RENDER_POLL_MS); // not our child, check ours by timer
+        }
+    }
+}
+
+//! \brief Start external command without shell. If RENDER_MAX_JOBS commands
+//! are running, waits for one of them. Errors are reported, when the command
+//! is finished (see render_wait)
+//! \param [in] argv Command and arguments, NULL terminated
+//! \param [in] phase Phase from Stat_Phases to add the time to
+//! \param [in] input Mmaped data for stdin of the command (NULL for none), it
+//! is written through pipe, while the program continues, and is unmapped after
+//! \param [in] input_size Size of input
+//! \param [in] then Command to start after this one succeeds (e.g. viewer), NULL for none
+//! \param [in] then_phase Phase of the next command
+//! \param [in] output File, written by the command
+//! \param [in] cache_entry Where to save output in render cache (render_cache_entry), NULL for none
+//! \return Returns 0, if the command is started, -1 else
+int
+render_spawn(const char *const *argv, int phase, char *input, long input_size,
+             const char *const *then, int then_phase, const char *output, const char *cache_entry) {
+    if (input) {
+        signal(SIGPIPE, SIG_IGN); // renderer may exit without reading everything
+    }
+    while (render_running >= render_limit) {
+        render_poll(true);
+    }
+    struct Render_Job *job = find_job(0);
+    if (!job || copy_args(job->argv, argv) || copy_args(job->then, then)) {
+        if (job) {
+            free_args(job->argv);
+        }
+        if (input) {
+            munmap(input, input_size);
+        }
+        render_failed++;
+        return -1;
+    }
+    job->phase = phase;
+    job->input = input;
+    job->input_size = input_size;
+    job->written = 0;
+    job->input_fd = -1;
+    job->then_phase = then_phase;
+    if (output && cache_entry) {
+        job->output = strdup(output);
+        job->cache_entry = strdup(cache_entry);
+    }
+    if (start_job(job)) {
+        render_failed++;
+        free_job(job);
+        return -1;
+    }
+    render_poll(false);
+    return 0;
+}
+
+//! \brief Wait for all started commands
+//! \return Returns number of commands, which failed since the previous call
+int
+render_wait() {
+    while (render_running) {
+        render_poll(true);
+    }
+    int failed = render_failed;
+    render_failed = 0;
+    return failed;
+}
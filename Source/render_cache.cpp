@@ -0,0 +1,165 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "render_cache.h"
+#include "disk_cache.h"
+#include "stats.h"
+
+//! \brief Identity of external tool: a new version of it is another file
+struct Cache_Tool {
+    char *name;
+    char *identity;     // path, size and time of modification, NULL if not found
+};
+
+//! \brief Directory with rendered files, named by hash of their source
+struct Render_Cache {
+    char *dir;
+    long max_bytes;
+    struct Cache_Tool tools[RENDER_CACHE_TOOLS];
+    int tools_num;
+};
+
+static struct Render_Cache *render_cache = NULL;
+
+//! \brief Start using render cache
+//! \param [in] dir Directory of the cache, NULL for the default one
+//! \param [in] max_bytes Size of the cache, checked by render_cache_close
+//! \return Returns 0 in success -1 else
+int
+render_cache_open(const char *dir, long max_bytes) {
+    char *path = disk_cache_dir(dir, RENDER_CACHE_DIR);
+    if (!path) {
+        return -1;
+    }
+    render_cache = (struct Render_Cache *)calloc(1, sizeof(*render_cache));
+    if (!render_cache) {
+        fprintf(stderr, "Can not allocate memory\n");
+        free(path);
+        return -1;
+    }
+    render_cache->dir = path;
+    render_cache->max_bytes = max_bytes;
+    return 0;
+}
+
+//! \brief Stop using render cache, its size is bounded here
+void
+render_cache_close() {
+    if (!render_cache) {
+        return;
+    }
+    disk_cache_evict(render_cache->dir, render_cache->max_bytes, RENDER_CACHE_EVICTED);
+    for (int i = 0; i < render_cache->tools_num; i++) {
+        free(render_cache->tools[i].name);
+        free(render_cache->tools[i].identity);
+    }
+    free(render_cache->dir);
+    free(render_cache);
+    render_cache = NULL;
+}
+
+//! \brief Check, if render cache is open
+bool
+render_cache_used() {
+    return render_cache != NULL;
+}
+
+//! \brief Find tool in PATH, its identity changes with its version
+//! \return Returns identity or NULL, if the tool is not found
+static const char *
+tool_identity(struct Render_Cache *cache, const char *tool) {
+    for (int i = 0; i < cache->tools_num; i++) {
+        if (!strcmp(cache->tools[i].name, tool)) {
+            return cache->tools[i].identity;
+        }
+    }
+    struct Cache_Tool *found = &cache->tools[std::min(cache->tools_num, RENDER_CACHE_TOOLS - 1)];
+    if (cache->tools_num < RENDER_CACHE_TOOLS) {
+        cache->tools_num++;
+    } else {
+        free(found->name);
+        free(found->identity);
+    }
+    found->name = strdup(tool);
+    found->identity = NULL;
+    const char *path = getenv("PATH");
+    while (path && *path) {
+        const char *end = strchr(path, ':');
+        std::string name = std::string(path, end ? end - path : strlen(path)) + "/" + tool;
+        if (!access(name.c_str(), X_OK)) {
+            found->identity = disk_cache_identity(name.c_str());
+            if (found->identity) {
+                break;
+            }
+        }
+        path = end ? end + 1 : NULL;
+    }
+    return found->identity;
+}
+
+//! \brief Name of cached output for the source text
+//! \param [in] tool Renderer, its version is a part of the key
+//! \param [in] args Arguments of the renderer, which change the output
+//! \param [in] text Source
+//! \param [in] size Size of text
+//! \param [in] extension Extension of output (".png")
+//! \return Returns allocated file name or NULL, if cache is not used or tool is not found
+char *
+render_cache_entry(const char *tool, const char *args, const char *text, long size, const char *extension) {
+    if (!render_cache || !text) {
+        return NULL;
+    }
+    const char *identity = tool_identity(render_cache, tool);
+    if (!identity) {
+        return NULL; // renderer fails anyway
+    }
+    const char *keys[] = {identity, args};
+    return disk_cache_entry(render_cache->dir, keys, 2, text, size, extension);
+}
+
+//! \brief Put cached output into place of the renderer output: by hard link,
+//! or by copy, if the cache is on other file system. Used entry becomes the
+//! newest for eviction
+//! \param [in] entry Cached file (render_cache_entry)
+//! \param [in] out Output file
+//! \return Returns true in hit, false, if output must be rendered
+bool
+render_cache_fetch(const char *entry, const char *out) {
+    if (!entry || access(entry, R_OK)) {
+        STAT_INC(RENDER_CACHE_MISSES);
+        return false;
+    }
+    unlink(out);
+    if (link(entry, out) && disk_cache_copy(entry, out, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)) {
+        STAT_INC(RENDER_CACHE_MISSES);
+        return false;
+    }
+    utimensat(AT_FDCWD, entry, NULL, 0);
+    STAT_INC(RENDER_CACHE_HITS);
+    return true;
+}
+
+//! \brief Save rendered output into the cache. Entry is written by copy and
+//! rename, so readers never see a part of it, and is read only, so writers of
+//! outputs, linked with it, do not change it
+//! \param [in] out Rendered file
+//! \param [in] entry Cached file (render_cache_entry)
+//! \return Returns 0 in success -1 else
+int
+render_cache_store(const char *out, const char *entry) {
+    std::string tmp = std::string(entry) + "." + std::to_string(getpid()) + ".tmp";
+    if (disk_cache_copy(out, tmp.c_str(), S_IRUSR | S_IRGRP | S_IROTH)) {
+        return -1;
+    }
+    if (rename(tmp.c_str(), entry)) {
+        unlink(tmp.c_str());
+        return -1;
+    }
+    return 0;
+}
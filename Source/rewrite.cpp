@@ -0,0 +1,517 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#include "tree.h"
+#include "rewrite.h"
+#include "stats.h"
+
+//! \brief Rules of the simplifier. Every name in a pattern is a wildcard,
+//! the same name twice means equal subtrees
+static const char *simplify_rules_text[][2] = {
+    {"((x) * (0))", "(0)"},
+    {"((0) * (x))", "(0)"},
+    {"((x) ^ (1))", "(x)"},
+    {"((1) ^ (x))", "(1)"},
+    {"((x) / (1))", "(x)"},
+    {"((x) - (x))", "(0)"},
+    {"((0) - (x))", "((-1) * (x))"},
+    {"(((x) - (y)) + (y))", "(x)"},
+    {"(((x) + (y)) - (y))", "(x)"},
+    {"((x) / (x))", "(1)"},
+    {"((0) / (x))", "(0)"},
+    {"((0) ^ (x))", "(0)"},
+    {"((x) ^ (0))", "(1)"},
+    {"(((x) * (y)) / (y))", "(x)"},
+    {"(((y) * (x)) / (y))", "(x)"},
+    {"(ln((x) ^ (y)))", "((y) * (ln(x)))"},
+    {"(ln(1))", "(0)"},
+    {"((x) * ((x) ^ (y)))", "((x) ^ ((y) + (1)))"},
+    {"(((x) ^ (y)) * (x))", "((x) ^ ((y) + (1)))"},
+    {"(((x) ^ (y)) * ((x) ^ (z)))", "((x) ^ ((y) + (z)))"},
+    {"(((x) ^ (y)) / ((x) ^ (z)))", "((x) ^ ((y) - (z)))"},
+    {"(((sin(x)) ^ (2)) + ((cos(x)) ^ (2)))", "(1)"},
+    {"(((cos(x)) ^ (2)) + ((sin(x)) ^ (2)))", "(1)"},
+};
+
+enum Disc_Key_Kinds {
+    KEY_OPERATION = 0,
+    KEY_CONSTANT,
+    KEY_WILDCARD
+};
+
+//! \brief One symbol of pattern in preorder
+struct Disc_Key {
+    int kind;
+    int operation;
+    int arity;
+    double value;
+};
+
+//! \brief Discrimination tree vertex: edges by the next symbol, rules which end here
+struct Disc_Vertex {
+    std::vector<struct Disc_Key> keys;
+    std::vector<int> next;
+    std::vector<int> rules;
+};
+
+struct Rule {
+    Node *lhs;
+    Node *rhs;
+    std::vector<int> wildcards; // symbol ids of wildcards in preorder of lhs
+};
+
+//! \brief Which folds of the first operands of n-ary node may match a pattern.
+//! A pattern, whose first operand is a constant or other operation, matches
+//! only short folds; one, whose first operand is a wildcard, matches a fold
+//! of any length, which ends with an operand matching its last operand
+struct Fold_Filter {
+    int fixed;                          // folds of up to so many operands are always tried
+    std::vector<struct Disc_Key> last;  // last operands of patterns with a wildcard first operand
+    bool repeat;                        // pattern (x) op (x), the last operand repeats the fold
+};
+
+struct Rule_Set {
+    std::vector<struct Rule> rules;
+    std::vector<struct Disc_Vertex> vertices;
+    std::vector<struct Fold_Filter> folds; // by operation
+};
+
+//! \brief Check, if two keys are the same symbol
+static bool
+key_eq(struct Disc_Key *key1, struct Disc_Key *key2) {
+    if (key1->kind != key2->kind) {
+        return false;
+    }
+    switch (key1->kind) {
+        case KEY_OPERATION:
+            return key1->operation == key2->operation && key1->arity == key2->arity;
+        case KEY_CONSTANT:
+            return is_eq(key1->value, key2->value);
+        default:
+            return true;
+    }
+}
+
+//! \brief Check, if n-ary node of the operation is left fold of its operands
+static bool
+is_fold_operation(int operation) {
+    return operation == ADD || operation == SUB || operation == MUL || operation == DIV || operation == POWER;
+}
+
+//! \brief Symbol of the top node of pattern
+static struct Disc_Key
+pattern_key(Node *pattern) {
+    struct Disc_Key key;
+    memset(&key, 0, sizeof(key));
+    switch (pattern->get_operation()) {
+        case CONSTANT:
+            key.kind = KEY_CONSTANT;
+            key.value = pattern->get_value();
+            break;
+        case VAR:
+            key.kind = KEY_WILDCARD;
+            break;
+        default:
+            key.kind = KEY_OPERATION;
+            key.operation = pattern->get_operation();
+            key.arity = pattern->get_children_number();
+            break;
+    }
+    return key;
+}
+
+//! \brief Insert pattern into discrimination tree
+//! \param [in] set Rule set
+//! \param [in] vertex Current vertex
+//! \param [in] pattern Current pattern subtree
+//! \param [in] rule Rule index
+//! \return Returns vertex after the pattern subtree
+static int
+insert_pattern(struct Rule_Set *set, int vertex, Node *pattern, int rule) {
+    struct Disc_Key key = pattern_key(pattern);
+    if (key.kind == KEY_WILDCARD) {
+        set->rules[rule].wildcards.push_back(pattern->get_name_id());
+    }
+    int next = -1;
+    for (size_t i = 0; i < set->vertices[vertex].keys.size(); i++) {
+        if (key_eq(&set->vertices[vertex].keys[i], &key)) {
+            next = set->vertices[vertex].next[i];
+            break;
+        }
+    }
+    if (next < 0) {
+        next = set->vertices.size();
+        set->vertices[vertex].keys.push_back(key);
+        set->vertices[vertex].next.push_back(next);
+        set->vertices.push_back(Disc_Vertex());
+    }
+    if (key.kind == KEY_OPERATION) {
+        for (int i = 0; i < pattern->get_children_number(); i++) {
+            next = insert_pattern(set, next, pattern->get_childs()[i], rule);
+        }
+    }
+    return next;
+}
+
+//! \brief Parse pattern in full-parenthesis format
+static Node *
+parse_pattern(const char *text) {
+    int len = strlen(text);
+    char *str = (char *)calloc(len + 1, sizeof(char));
+    memcpy(str, text, len);
+    Node *pattern = parse_str_create_tree(str, len);
+    free(str);
+    if (!pattern) {
+        fprintf(stderr, "Can not parse rewrite pattern %s\n", text);
+    }
+    return pattern;
+}
+
+//! \brief Add binary pattern of n-ary operation into the fold filter of the operation
+static void
+add_fold_filter(struct Rule_Set *set, Node *pattern) {
+    int operation = pattern->get_operation();
+    if (!is_fold_operation(operation) || pattern->get_children_number() != 2) {
+        return;
+    }
+    if ((int)set->folds.size() <= operation) {
+        set->folds.resize(operation + 1, Fold_Filter{0, {}, false});
+    }
+    struct Fold_Filter *filter = &set->folds[operation];
+    // ((a op b) op c) matches the fold of the first operands of a op b op c
+    int depth = 1;
+    Node *first = pattern->get_childs()[0];
+    while (first->get_operation() == operation && first->get_children_number() == 2) {
+        depth++;
+        first = first->get_childs()[0];
+    }
+    Node *last = pattern->get_childs()[1];
+    if (first->get_operation() != VAR) { // the first operand itself or a fold of its arity
+        int operands = depth + (first->get_operation() == operation ? first->get_children_number() : 1);
+        filter->fixed = std::max(filter->fixed, operands);
+    } else if (depth == 1 && last->get_operation() == VAR && last->get_name_id() == first->get_name_id()) {
+        filter->fixed = std::max(filter->fixed, 2); // two equal operands
+        filter->repeat = true;
+    } else {
+        filter->last.push_back(pattern_key(last));
+    }
+}
+
+//! \brief Compile rules 'pattern -> replacement' into one discrimination tree
+//! \param [in] rules Pairs of pattern and replacement in full-parenthesis format
+//! \param [in] rules_num Number of rules
+//! \return Returns compiled rule set or NULL
+struct Rule_Set *
+compile_rules(const char *rules[][2], int rules_num) {
+    struct Rule_Set *set = new Rule_Set;
+    set->vertices.push_back(Disc_Vertex());
+    for (int i = 0; i < rules_num; i++) {
+        struct Rule rule;
+        rule.lhs = parse_pattern(rules[i][0]);
+        rule.rhs = parse_pattern(rules[i][1]);
+        if (!rule.lhs || !rule.rhs) {
+            rec_del(rule.lhs);
+            rec_del(rule.rhs);
+            free_rules(set);
+            return NULL;
+        }
+        set->rules.push_back(rule);
+        int last = insert_pattern(set, 0, rule.lhs, set->rules.size() - 1);
+        set->vertices[last].rules.push_back(set->rules.size() - 1);
+        add_fold_filter(set, rule.lhs);
+    }
+    return set;
+}
+
+//! \brief Free compiled rules
+//! \param [in] set Rule set
+void
+free_rules(struct Rule_Set *set) {
+    if (!set) {
+        return;
+    }
+    for (size_t i = 0; i < set->rules.size(); i++) {
+        rec_del(set->rules[i].lhs);
+        rec_del(set->rules[i].rhs);
+    }
+    delete set;
+}
+
+//! \brief Number of rules in the set
+int
+rules_number(struct Rule_Set *set) {
+    return set ? set->rules.size() : 0;
+}
+
+//! \brief Left side of the rule
+//! \param [in] set Rule set
+//! \param [in] rule Rule index
+//! \return Returns pattern, owned by the set
+Node *
+rule_pattern(struct Rule_Set *set, int rule) {
+    return set->rules[rule].lhs;
+}
+
+//! \brief Right side of the rule
+//! \param [in] set Rule set
+//! \param [in] rule Rule index
+//! \return Returns replacement, owned by the set
+Node *
+rule_replacement(struct Rule_Set *set, int rule) {
+    return set->rules[rule].rhs;
+}
+
+//! \brief Rules used by Node::simplify, compiled once
+//! \return Returns rule set
+struct Rule_Set *
+simplify_rules() {
+    static struct Rule_Set *set = compile_rules(simplify_rules_text,
+            sizeof(simplify_rules_text) / sizeof(simplify_rules_text[0]));
+    return set;
+}
+
+//! \brief Subterm of matching: node or, for n-ary operation, left fold of its
+//! first operands. a - b - c is (a - b) - c, as in get_val, so binary patterns
+//! match n-ary nodes
+struct Term {
+    Node *node;
+    int operands;   // children of the node in the fold, all for the whole node
+};
+
+static struct Term
+whole_term(Node *node) {
+    return Term{node, node->get_children_number()};
+}
+
+//! \brief Fold of the first operands, fold of one operand is the operand itself
+static struct Term
+fold_term(Node *node, int operands) {
+    return operands == 1 ? whole_term(node->get_childs()[0]) : Term{node, operands};
+}
+
+static bool
+is_whole(struct Term term) {
+    return term.operands == term.node->get_children_number();
+}
+
+//! \brief Check, if terms are equal subtrees
+static bool
+term_same(struct Term first, struct Term second) {
+    if (is_whole(first) && is_whole(second)) {
+        return tree_same(first.node, second.node);
+    }
+    if (first.node->get_operation() != second.node->get_operation() || first.operands != second.operands) {
+        return false;
+    }
+    for (int i = 0; i < first.operands; i++) {
+        if (!tree_same(first.node->get_childs()[i], second.node->get_childs()[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//! \brief Copy term into a new tree
+static Node *
+term_copy(struct Term term) {
+    if (is_whole(term)) {
+        return term.node->copy();
+    }
+    Node *res = new Node(term.node->get_operation());
+    for (int i = 0; i < term.operands; i++) {
+        res->add_child(term.node->get_childs()[i]->copy());
+    }
+    return res;
+}
+
+//! \brief Check that the same wildcard is bound to equal subtrees
+static bool
+check_bindings(struct Rule *rule, std::vector<struct Term> &binds) {
+    for (size_t i = 0; i < binds.size(); i++) {
+        for (size_t j = 0; j < i; j++) {
+            if (rule->wildcards[i] == rule->wildcards[j] && !term_same(binds[i], binds[j])) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+//! \brief State of one matching
+struct Match {
+    std::vector<struct Term> pending; // subterms left to match, top is the next in preorder
+    std::vector<struct Term> binds;   // subterms matched by wildcards
+    int best_rule;
+    std::vector<struct Term> best_binds;
+};
+
+//! \brief Walk discrimination tree along the term
+//! \param [in] set Rule set
+//! \param [in] vertex Current vertex
+//! \param [in,out] match Matching state
+static void
+match_rec(struct Rule_Set *set, int vertex, struct Match *match) {
+    struct Disc_Vertex *cur = &set->vertices[vertex];
+    if (match->pending.empty()) {
+        for (size_t i = 0; i < cur->rules.size(); i++) {
+            int rule = cur->rules[i];
+            if ((match->best_rule < 0 || rule < match->best_rule) &&
+                check_bindings(&set->rules[rule], match->binds)) {
+                match->best_rule = rule;
+                match->best_binds = match->binds;
+            }
+        }
+        return;
+    }
+    struct Term term = match->pending.back();
+    Node *node = term.node;
+    for (size_t i = 0; i < cur->keys.size(); i++) {
+        struct Disc_Key *key = &cur->keys[i];
+        int next = cur->next[i];
+        switch (key->kind) {
+            case KEY_WILDCARD:
+                match->pending.pop_back();
+                match->binds.push_back(term);
+                match_rec(set, next, match);
+                match->binds.pop_back();
+                match->pending.push_back(term);
+                break;
+            case KEY_CONSTANT:
+                if (node->get_operation() == CONSTANT && is_eq(node->get_value(), key->value)) {
+                    match->pending.pop_back();
+                    match_rec(set, next, match);
+                    match->pending.push_back(term);
+                }
+                break;
+            default:
+                if (node->get_operation() != key->operation) {
+                    break;
+                }
+                if (term.operands == key->arity) {
+                    match->pending.pop_back();
+                    for (int j = key->arity - 1; j >= 0; j--) {
+                        match->pending.push_back(whole_term(node->get_childs()[j]));
+                    }
+                    match_rec(set, next, match);
+                    match->pending.resize(match->pending.size() - key->arity);
+                    match->pending.push_back(term);
+                } else if (key->arity == 2 && term.operands > 2 && is_fold_operation(key->operation)) {
+                    match->pending.pop_back();
+                    match->pending.push_back(whole_term(node->get_childs()[term.operands - 1]));
+                    match->pending.push_back(fold_term(node, term.operands - 1));
+                    match_rec(set, next, match);
+                    match->pending.resize(match->pending.size() - 2);
+                    match->pending.push_back(term);
+                }
+                break;
+        }
+    }
+}
+
+//! \brief Build replacement with wildcards substituted by copies of bound subtrees
+static Node *
+instantiate(Node *rhs, struct Rule *rule, std::vector<struct Term> &binds) {
+    if (rhs->get_operation() == VAR) {
+        for (size_t i = 0; i < rule->wildcards.size(); i++) {
+            if (rule->wildcards[i] == rhs->get_name_id()) {
+                return term_copy(binds[i]);
+            }
+        }
+    }
+    if (rhs->get_operation() == CONSTANT || rhs->get_operation() == VAR) {
+        return rhs->copy();
+    }
+    Node *res = new Node(rhs->get_operation());
+    for (int i = 0; i < rhs->get_children_number(); i++) {
+        res->add_child(instantiate(rhs->get_childs()[i], rule, binds));
+    }
+    return res;
+}
+
+//! \brief Check, if the fold of the first operands of node may match some
+//! pattern, without matching it
+//! \param [in] filter Fold filter of the node operation
+//! \param [in] node N-ary node
+//! \param [in] operands Operands in the fold
+static bool
+may_match_fold(struct Fold_Filter *filter, Node *node, int operands) {
+    if (operands <= filter->fixed) {
+        return true;
+    }
+    Node *last = node->get_childs()[operands - 1];
+    if (filter->repeat && last->get_operation() == node->get_operation() &&
+        last->get_children_number() == operands - 1) {
+        return true;
+    }
+    for (size_t i = 0; i < filter->last.size(); i++) {
+        struct Disc_Key *key = &filter->last[i];
+        switch (key->kind) {
+            case KEY_WILDCARD:
+                return true;
+            case KEY_CONSTANT:
+                if (last->get_operation() == CONSTANT && is_eq(last->get_value(), key->value)) {
+                    return true;
+                }
+                break;
+            default: // n-ary operand may match binary pattern as a fold
+                if (last->get_operation() == key->operation) {
+                    return true;
+                }
+                break;
+        }
+    }
+    return false;
+}
+
+//! \brief remove_children filter: child, which is in the fold of the first *(int *)arg operands
+static bool
+is_folded(Node *, int child_ind, void *arg) {
+    return child_ind < *(int *)arg;
+}
+
+//! \brief Find the first rule, which matches node, and rewrite node in place.
+//! N-ary node is matched as a whole, then folds of its first operands, which
+//! pass the fold filter, are matched, the result of a fold replaces its operands
+//! \param [in] set Rule set
+//! \param [in] node Node to rewrite
+//! \return Returns true, if node was rewritten
+bool
+rewrite_node(struct Rule_Set *set, Node *node) {
+    if (!set || !node) {
+        return false;
+    }
+    int children = node->get_children_number();
+    int operation = node->get_operation();
+    struct Fold_Filter *filter = NULL;
+    int last = children;
+    if (is_fold_operation(operation) && children > 2 && operation < (int)set->folds.size()) {
+        filter = &set->folds[operation];
+        last = 2;
+    }
+    struct Match match;
+    for (int operands = children; operands >= last; operands--) {
+        if (operands < children && !may_match_fold(filter, node, operands)) {
+            continue;
+        }
+        match.best_rule = -1;
+        match.pending.assign(1, Term{node, operands});
+        match_rec(set, 0, &match);
+        if (match.best_rule < 0) {
+            continue;
+        }
+        struct Rule *rule = &set->rules[match.best_rule];
+        Node *res = instantiate(rule->rhs, rule, match.best_binds);
+        if (operands == children) {
+            node->replace_by(res);
+        } else {
+            rec_del(node->replace_child(0, res));
+            node->remove_children(is_folded, &operands, 1);
+        }
+        STAT_INC(RULE_REWRITE);
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,161 @@
+#include <cstdio>
+#include <ctime>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "stats.h"
+#include "trace.h"
+
+long long stat_counters[STAT_COUNTERS_NUM];
+static long long stat_phases[STAT_PHASES_NUM];
+
+static const char *counter_names[STAT_COUNTERS_NUM] = {
+    "nodes_created",
+    "nodes_freed",
+    "simplify_iterations",
+    "remove_neitrals",
+    "calculate_values",
+    "union_layers",
+    "transform_constants",
+    "transform_vars",
+    "simp_var",
+    "rewrite_rules",
+    "poly_normal_form",
+    "egraph_iterations",
+    "egraph_nodes",
+    "cse_shared",
+    "plot_points",
+    "simplify_cache_hits",
+    "lazy_expanded",
+    "lazy_skipped",
+    "batch_points",
+    "batch_steals",
+    "bytes_written",
+    "subprocess_calls",
+    "subprocess_failed",
+    "render_cache_hits",
+    "render_cache_misses",
+    "render_cache_evicted",
+    "parse_cache_hits",
+    "parse_cache_misses",
+    "parse_cache_evicted"
+};
+
+static const char *phase_names[STAT_PHASES_NUM] = {
+    "total",
+    "parse",
+    "simplify",
+    "derivate",
+    "export_dot",
+    "export_tex",
+    "export_html",
+    "dot",
+    "pdftex",
+    "viewer",
+    "plot",
+    "eval"
+};
+
+//! \brief Monotonic time for phase timers
+//! \return Returns time in nanoseconds
+long long
+stats_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+//! \brief Start phase: take time and open trace span
+//! \param [in] phase Phase from Stat_Phases
+//! \return Returns start time for stats_add_time
+long long
+stats_begin(int phase) {
+    TRACE_BEGIN(phase_names[phase]);
+    return stats_now();
+}
+
+//! \brief Add time passed since start to the phase
+//! \param [in] phase Phase from Stat_Phases
+//! \param [in] start Value of stats_begin() at the beginning of the phase
+void
+stats_add_time(int phase, long long start) {
+    stat_phases[phase] += stats_now() - start;
+    TRACE_END(phase_names[phase]);
+}
+
+//! \brief Add time of phase, which ran at the same time as others (external
+//! process), so its trace span is not nested
+//! \param [in] phase Phase from Stat_Phases
+//! \param [in] start stats_now() at the beginning of the phase
+//! \param [in] arg Argument of trace span (pid)
+void
+stats_add_async(int phase, long long start, long arg) {
+    stat_phases[phase] += stats_now() - start;
+    if (trace_enabled) {
+        trace_complete(phase_names[phase], start, arg);
+    }
+}
+
+//! \brief Write string as json string
+static void
+dump_json_string(int fd, const char *str) {
+    dprintf(fd, "\"");
+    for (; str && *str; str++) {
+        if (*str == '"' || *str == '\\') {
+            dprintf(fd, "\\%c", *str);
+        } else if ((unsigned char)*str < ' ') {
+            dprintf(fd, "\\u%04x", *str);
+        } else {
+            dprintf(fd, "%c", *str);
+        }
+    }
+    dprintf(fd, "\"");
+}
+
+//! \brief Write all counters and phase times in json format
+//! \param [in] fd File descriptor
+//! \param [in] program Name of the program
+//! \param [in] input Input file name
+//! \return Returns 0 in success, -1 else
+int
+stats_dump_json(int fd, const char *program, const char *input) {
+    if (fd < 0) {
+        return -1;
+    }
+    dprintf(fd, "{\n  \"program\": ");
+    dump_json_string(fd, program);
+    dprintf(fd, ",\n  \"input\": ");
+    dump_json_string(fd, input);
+    dprintf(fd, ",\n  \"phases_ns\": {");
+    for (int i = 0; i < STAT_PHASES_NUM; i++) {
+        dprintf(fd, "%s\n    \"%s\": %lld", i ? "," : "", phase_names[i], stat_phases[i]);
+    }
+    dprintf(fd, "\n  },\n  \"counters\": {");
+    for (int i = 0; i < STAT_COUNTERS_NUM; i++) {
+        dprintf(fd, "%s\n    \"%s\": %lld", i ? "," : "", counter_names[i], stat_counters[i]);
+    }
+    dprintf(fd, "\n  }\n}\n");
+    return 0;
+}
+
+//! \brief Write statistics into file or to stdout
+//! \param [in] filename Output file, NULL for stdout
+//! \param [in] program Name of the program
+//! \param [in] input Input file name
+//! \return Returns 0 in success, -1 else
+int
+stats_write(char *filename, const char *program, const char *input) {
+    if (!filename) {
+        return stats_dump_json(STDOUT_FILENO, program, input);
+    }
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (fd < 0) {
+        fprintf(stderr, "Can not open stats file %s\n", filename);
+        return -1;
+    }
+    int res = stats_dump_json(fd, program, input);
+    close(fd);
+    return res;
+}
@@ -0,0 +1,82 @@
+#include <cstring>
+#include <string>
+#include <deque>
+#include <unordered_map>
+
+#include "tree.h"
+#include "symbols.h"
+
+//! \brief Names of operations, symbol id of operation name is the operation code
+static const char *operation_names[] = {
+    "", "x", "+", "-", "*", "/", "^", "ln", "sin", "cos", "=", ">", "<", "~",
+    "if", "while", "for", "do", "?", "?", "return", "d/d"
+};
+
+//! \brief Symbol table: every name is stored once, deque keeps c_str() pointers valid
+struct Symbol_Table {
+    std::deque<std::string> names;
+    std::unordered_map<std::string, int> ids;
+
+    Symbol_Table() {
+        for (size_t i = 0; i < sizeof(operation_names) / sizeof(operation_names[0]); i++) {
+            names.push_back(operation_names[i]);
+            ids.emplace(operation_names[i], i);
+        }
+    }
+};
+
+static Symbol_Table &
+symbols() {
+    static Symbol_Table table;
+    return table;
+}
+
+//! \brief Get id of the name, adding it to the table if necessary
+//! \param [in] name Name (not necessarily '\0' terminated)
+//! \param [in] name_len Name length
+//! \return Returns symbol id
+int
+intern_symbol(const char *name, int name_len) {
+    Symbol_Table &table = symbols();
+    std::string key(name, name_len);
+    auto found = table.ids.find(key);
+    if (found != table.ids.end()) {
+        return found->second;
+    }
+    int id = table.names.size();
+    table.names.push_back(key);
+    table.ids.emplace(key, id);
+    return id;
+}
+
+//! \brief Get id of the '\0' terminated name
+int
+intern_symbol(const char *name) {
+    return intern_symbol(name, strlen(name));
+}
+
+//! \brief Get name of the symbol
+//! \param [in] id Symbol id
+//! \return Returns name or NULL for SYMBOL_NONE
+const char *
+symbol_name(int id) {
+    if (id == SYMBOL_NONE) {
+        return NULL;
+    }
+    return symbols().names[id].c_str();
+}
+
+//! \brief Get length of the symbol name
+int
+symbol_len(int id) {
+    if (id == SYMBOL_NONE) {
+        return 0;
+    }
+    return symbols().names[id].size();
+}
+
+//! \brief Number of symbols in the table, ids are less than it
+int
+symbols_number() {
+    return symbols().names.size();
+}
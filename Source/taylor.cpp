@@ -0,0 +1,405 @@
+#include <cstdio>
+#include <cmath>
+#include <vector>
+
+#include "tree.h"
+#include "taylor.h"
+#include "symbols.h"
+
+//! \brief Truncated power series: coefficient k is f^(k)(point) / k!
+typedef std::vector<double> Series;
+
+//! \brief Point of expansion and values of the other variables
+struct Taylor_Env {
+    int var_id;
+    double point;
+    const double *values;  // value by symbol id, NAN for unbound symbol
+    int values_num;
+    int order;
+};
+
+//! \brief res = first * second (Cauchy product)
+static void
+series_mul(const Series &first, const Series &second, Series *res) {
+    int size = first.size();
+    res->assign(size, 0);
+    for (int k = 0; k < size; k++) {
+        double sum = 0;
+        for (int i = 0; i <= k; i++) {
+            sum += first[i] * second[k - i];
+        }
+        (*res)[k] = sum;
+    }
+}
+
+//! \brief res = first / second: c_k = (a_k - sum(b_i * c_(k-i), i = 1..k)) / b_0
+static void
+series_div(const Series &first, const Series &second, Series *res) {
+    int size = first.size();
+    res->assign(size, 0);
+    for (int k = 0; k < size; k++) {
+        double sum = first[k];
+        for (int i = 1; i <= k; i++) {
+            sum -= second[i] * (*res)[k - i];
+        }
+        (*res)[k] = sum / second[0];
+    }
+}
+
+//! \brief res = ln(arg): from c' * a = a'
+static void
+series_ln(const Series &arg, Series *res) {
+    int size = arg.size();
+    res->assign(size, 0);
+    (*res)[0] = log(arg[0]);
+    for (int k = 1; k < size; k++) {
+        double sum = arg[k];
+        for (int i = 1; i < k; i++) {
+            sum -= i * (*res)[i] * arg[k - i] / k;
+        }
+        (*res)[k] = sum / arg[0];
+    }
+}
+
+//! \brief res = exp(arg): from c' = a' * c
+static void
+series_exp(const Series &arg, Series *res) {
+    int size = arg.size();
+    res->assign(size, 0);
+    (*res)[0] = exp(arg[0]);
+    for (int k = 1; k < size; k++) {
+        double sum = 0;
+        for (int i = 1; i <= k; i++) {
+            sum += i * arg[i] * (*res)[k - i];
+        }
+        (*res)[k] = sum / k;
+    }
+}
+
+//! \brief sin and cos of the series, they are computed together:
+//! s' = a' * c, c' = -a' * s
+static void
+series_sin_cos(const Series &arg, Series *sin_res, Series *cos_res) {
+    int size = arg.size();
+    sin_res->assign(size, 0);
+    cos_res->assign(size, 0);
+    (*sin_res)[0] = sin(arg[0]);
+    (*cos_res)[0] = cos(arg[0]);
+    for (int k = 1; k < size; k++) {
+        double sin_sum = 0;
+        double cos_sum = 0;
+        for (int i = 1; i <= k; i++) {
+            sin_sum += i * arg[i] * (*cos_res)[k - i];
+            cos_sum -= i * arg[i] * (*sin_res)[k - i];
+        }
+        (*sin_res)[k] = sin_sum / k;
+        (*cos_res)[k] = cos_sum / k;
+    }
+}
+
+//! \brief Check, if series is a constant (all derivatives are zero)
+static bool
+series_constant(const Series &arg) {
+    for (size_t i = 1; i < arg.size(); i++) {
+        if (arg[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//! \brief res = base ^ exponent for constant exponent
+static void
+series_pow_const(const Series &base, double exponent, Series *res) {
+    int size = base.size();
+    if (base[0] == 0 && exponent >= 0 && exponent == round(exponent)) {
+        // recurrence divides by base[0], natural power is taken by squaring
+        Series square = base;
+        Series tmp;
+        res->assign(size, 0);
+        (*res)[0] = 1;
+        for (long power = (long)exponent; power > 0; power /= 2) {
+            if (power % 2) {
+                series_mul(*res, square, &tmp);
+                res->swap(tmp);
+            }
+            if (power > 1) {
+                series_mul(square, square, &tmp);
+                square.swap(tmp);
+            }
+        }
+        return;
+    }
+    // from c' * a = p * a' * c
+    res->assign(size, 0);
+    (*res)[0] = pow(base[0], exponent);
+    for (int k = 1; k < size; k++) {
+        double sum = 0;
+        for (int i = 1; i <= k; i++) {
+            sum += (exponent * i - (k - i)) * base[i] * (*res)[k - i];
+        }
+        (*res)[k] = sum / (k * base[0]);
+    }
+}
+
+//! \brief res = base ^ exponent
+static void
+series_pow(const Series &base, const Series &exponent, Series *res) {
+    if (series_constant(exponent)) {
+        series_pow_const(base, exponent[0], res);
+        return;
+    }
+    Series log_base, tmp;   // a ^ b = exp(b * ln(a))
+    series_ln(base, &log_base);
+    series_mul(exponent, log_base, &tmp);
+    series_exp(tmp, res);
+}
+
+static int
+node_series(Node *node, struct Taylor_Env *env, Series *res);
+
+//! \brief Series of lazy derivate. Derivate by the expansion variable is the
+//! shifted series of the operand: c_k = (k + 1) * a_(k+1), so it is not built.
+//! Derivate by other variable is expanded in place once and is reused by the
+//! next calls
+static int
+derivate_series(Node *node, struct Taylor_Env *env, Series *res) {
+    if (node->get_name_id() != env->var_id) {
+        node->expand_lazy();
+        return node_series(node, env, res);
+    }
+    struct Taylor_Env operand_env = *env;
+    operand_env.order++;
+    Series operand;
+    if (node_series(node->get_childs()[0], &operand_env, &operand)) {
+        return -1;
+    }
+    res->assign(env->order + 1, 0);
+    for (int k = 0; k <= env->order; k++) {
+        (*res)[k] = (k + 1) * operand[k + 1];
+    }
+    return 0;
+}
+
+//! \brief Propagate truncated power series from leaves to the root
+//! \param [in] node Subtree
+//! \param [in] env Point and values of variables
+//! \param [out] res Series of the subtree
+//! \return Returns 0 in success -1 else
+static int
+node_series(Node *node, struct Taylor_Env *env, Series *res) {
+    res->assign(env->order + 1, 0);
+    int operation = node->get_operation();
+    if (operation == DERIVATE) {
+        return derivate_series(node, env, res);
+    }
+    if (operation == CONSTANT) {
+        (*res)[0] = node->get_value();
+        return 0;
+    }
+    if (operation == VAR) {
+        int name = node->get_name_id();
+        if (name == env->var_id) {
+            (*res)[0] = env->point;
+            if (env->order > 0) {
+                (*res)[1] = 1;
+            }
+            return 0;
+        }
+        if (name >= env->values_num || !env->values || std::isnan(env->values[name])) {
+            fprintf(stderr, "Variable %s has no value\n", symbol_name(name));
+            return -1;
+        }
+        (*res)[0] = env->values[name];
+        return 0;
+    }
+    if (operation < ADD || operation > COS || node->get_children_number() < 1) {
+        fprintf(stderr, "Can not expand operation %s into series\n", symbol_name(operation));
+        return -1;
+    }
+    Node **childs = node->get_childs();
+    Series operand, tmp;
+    if (node_series(childs[0], env, &operand)) {
+        return -1;
+    }
+    switch (operation) {
+        case LN:
+            series_ln(operand, res);
+            return 0;
+        case SIN:
+            series_sin_cos(operand, res, &tmp);
+            return 0;
+        case COS:
+            series_sin_cos(operand, &tmp, res);
+            return 0;
+        default:
+            break;
+    }
+    // the same left fold as in get_val
+    res->swap(operand);
+    for (int i = 1; i < node->get_children_number(); i++) {
+        if (node_series(childs[i], env, &operand)) {
+            return -1;
+        }
+        switch (operation) {
+            case ADD:
+                for (int k = 0; k <= env->order; k++) {
+                    (*res)[k] += operand[k];
+                }
+                continue;
+            case SUB:
+                for (int k = 0; k <= env->order; k++) {
+                    (*res)[k] -= operand[k];
+                }
+                continue;
+            case MUL:
+                series_mul(*res, operand, &tmp);
+                break;
+            case DIV:
+                series_div(*res, operand, &tmp);
+                break;
+            default: // POWER
+                series_pow(*res, operand, &tmp);
+                break;
+        }
+        res->swap(tmp);
+    }
+    return 0;
+}
+
+//! \brief Taylor coefficients of the expression in one forward pass
+//! \param [in] root Expression
+//! \param [in] var_id Symbol id of the variable
+//! \param [in] point Point of expansion
+//! \param [in] values Values of other variables by symbol id (NAN if unbound), may be NULL
+//! \param [in] values_num Size of values
+//! \param [in] order Maximal order, not greater than TAYLOR_MAX_ORDER
+//! \param [out] coefs Array of order + 1 coefficients: f^(k)(point) / k!
+//! \return Returns 0 in success -1 else
+int
+taylor_coefs(Node *root, int var_id, double point, const double *values, int values_num,
+             int order, double *coefs) {
+    if (!root || !coefs || order < 0 || order > TAYLOR_MAX_ORDER) {
+        fprintf(stderr, "Wrong order of Taylor series %d: expected 0..%d\n", order, TAYLOR_MAX_ORDER);
+        return -1;
+    }
+    struct Taylor_Env env = {var_id, point, values, values_num, order};
+    Series res;
+    if (node_series(root, &env, &res)) {
+        return -1;
+    }
+    for (int k = 0; k <= order; k++) {
+        coefs[k] = res[k];
+    }
+    return 0;
+}
+
+//! \brief All derivatives up to order at the point (Taylor coefficients times k!)
+//! \param [out] ders Array of order + 1 values: f^(k)(point)
+//! \return Returns 0 in success -1 else
+int
+taylor_derivatives(Node *root, int var_id, double point, const double *values, int values_num,
+                   int order, double *ders) {
+    if (taylor_coefs(root, var_id, point, values, values_num, order, ders)) {
+        return -1;
+    }
+    double factorial = 1;
+    for (int k = 1; k <= order; k++) {
+        factorial *= k;
+        ders[k] *= factorial;
+    }
+    return 0;
+}
+
+//! \brief Check, if tree is constant zero
+static bool
+is_zero(Node *node) {
+    return node->get_operation() == CONSTANT && is_eq(node->get_value(), 0);
+}
+
+//! \brief Derivates of the subtree of orders 0..order, each one simplified.
+//! Sums are derivated by children, products by Leibniz rule
+//! (a * b)^(k) = sum(C(k, j) * a^(j) * b^(k - j)), so derivates of operands
+//! are taken once and reused for every order. Other operations are derivated
+//! from the previous order.
+//! \param [in] node Subtree
+//! \param [in] var_id Symbol id of the variable
+//! \param [in] order Maximal order
+//! \param [out] res Derivates, res[0] is a copy of the subtree
+static void
+derivates_rec(Node *node, int var_id, int order, std::vector<Node *> *res) {
+    int operation = node->get_operation();
+    res->assign(order + 1, NULL);
+    (*res)[0] = node->copy();
+    if (operation == ADD || operation == SUB || operation == MUL) {
+        std::vector<Node *> acc, child;
+        derivates_rec(node->get_childs()[0], var_id, order, &acc);
+        for (int i = 1; i < node->get_children_number(); i++) {
+            derivates_rec(node->get_childs()[i], var_id, order, &child);
+            // from the highest order: acc[j] of lower orders are still needed
+            for (int k = order; k >= 0; k--) {
+                Node *sum = NULL;
+                if (operation != MUL) {
+                    sum = new Node(operation);
+                    sum->add_child(acc[k]);
+                    sum->add_child(child[k]->copy());
+                } else {
+                    sum = new Node(ADD);
+                    double binom = 1;
+                    for (int j = 0; j <= k; j++) {
+                        if (!is_zero(acc[j]) && !is_zero(child[k - j])) {
+                            Node *term = new Node(MUL);
+                            if (!is_eq(binom, 1)) {
+                                term->add_child(new Node(binom));
+                            }
+                            term->add_child(acc[j]->copy());
+                            term->add_child(child[k - j]->copy());
+                            sum->add_child(term);
+                        }
+                        binom = binom * (k - j) / (j + 1);
+                    }
+                    if (!sum->get_children_number()) {
+                        sum->replace_by(new Node(0.0));
+                    }
+                    rec_del(acc[k]);
+                }
+                sum->simplify();
+                acc[k] = sum;
+            }
+            for (int k = 0; k <= order; k++) {
+                rec_del(child[k]);
+            }
+        }
+        rec_del(acc[0]);
+        for (int k = 1; k <= order; k++) {
+            (*res)[k] = acc[k];
+        }
+        return;
+    }
+    for (int k = 1; k <= order; k++) {
+        if (is_zero((*res)[k - 1])) {
+            (*res)[k] = new Node(0.0);
+            continue;
+        }
+        (*res)[k] = (*res)[k - 1]->derivate(var_id);
+        (*res)[k]->simplify();
+    }
+}
+
+//! \brief Create new tree with derivate of the given order
+//! \param [in] root Expression
+//! \param [in] var_id Symbol id of the variable
+//! \param [in] order Order of the derivate
+//! \return Returns root of the new (simplified) tree or NULL
+Node *
+derivate_order(Node *root, int var_id, int order) {
+    if (!root || order < 0) {
+        return NULL;
+    }
+    std::vector<Node *> ders;
+    derivates_rec(root, var_id, order, &ders);
+    for (int k = 0; k < order; k++) {
+        rec_del(ders[k]);
+    }
+    return ders[order];
+}
@@ -0,0 +1,157 @@
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <atomic>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+bool trace_enabled = false;
+int trace_min_nodes = TRACE_DEFAULT_MIN_NODES;
+
+//! \brief One begin or end of span
+struct Trace_Event {
+    const char *name;
+    long long ts_ns;
+    long long dur_ns;   // for complete event ('X')
+    long arg;
+    char phase;
+};
+
+//! \brief Fixed size part of thread buffer, so appending never moves events
+struct Trace_Chunk {
+    struct Trace_Event events[TRACE_CHUNK_EVENTS];
+    int size;
+    struct Trace_Chunk *next;
+};
+
+//! \brief Events of one thread. Only its own thread writes into it,
+//! so no locks are needed until trace_write, which is called after all threads are done
+struct Trace_Buffer {
+    struct Trace_Chunk *first;
+    struct Trace_Chunk *last;
+    int tid;
+    struct Trace_Buffer *next;
+};
+
+static std::atomic<struct Trace_Buffer *> all_buffers(NULL);
+static std::atomic<int> threads_num(0);
+static thread_local struct Trace_Buffer *thread_buffer = NULL;
+
+//! \brief Create buffer for the current thread and push it into the global list
+//! \return Returns new buffer or NULL
+static struct Trace_Buffer *
+register_thread() {
+    struct Trace_Buffer *buffer = (struct Trace_Buffer *)calloc(1, sizeof(*buffer));
+    struct Trace_Chunk *chunk = (struct Trace_Chunk *)calloc(1, sizeof(*chunk));
+    if (!buffer || !chunk) {
+        fprintf(stderr, "Can not allocate trace buffer\n");
+        free(buffer);
+        free(chunk);
+        return NULL;
+    }
+    buffer->first = buffer->last = chunk;
+    buffer->tid = ++threads_num;
+    buffer->next = all_buffers.load();
+    while (!all_buffers.compare_exchange_weak(buffer->next, buffer)) {
+    }
+    return buffer;
+}
+
+//! \brief Append event to the buffer of the current thread
+//! \return Returns the event or NULL
+static struct Trace_Event *
+trace_event(const char *name, char phase, long arg) {
+    if (!thread_buffer) {
+        thread_buffer = register_thread();
+        if (!thread_buffer) {
+            return NULL;
+        }
+    }
+    struct Trace_Chunk *chunk = thread_buffer->last;
+    if (chunk->size == TRACE_CHUNK_EVENTS) {
+        chunk = (struct Trace_Chunk *)calloc(1, sizeof(*chunk));
+        if (!chunk) {
+            return NULL;
+        }
+        thread_buffer->last->next = chunk;
+        thread_buffer->last = chunk;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    struct Trace_Event *event = &chunk->events[chunk->size++];
+    event->name = name;
+    event->ts_ns = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    event->dur_ns = 0;
+    event->arg = arg;
+    event->phase = phase;
+    return event;
+}
+
+//! \brief Begin span
+//! \param [in] name Span name (string literal)
+//! \param [in] arg Optional numeric argument, shown as 'nodes' in the viewer, -1 if none
+void
+trace_begin(const char *name, long arg) {
+    trace_event(name, 'B', arg);
+}
+
+//! \brief End span, opened by trace_begin with the same name
+//! \param [in] name Span name
+void
+trace_end(const char *name) {
+    trace_event(name, 'E', -1);
+}
+
+//! \brief Span, which is not nested into others (external process, running
+//! at the same time as the program), it is recorded, when it is finished
+//! \param [in] name Span name (string literal)
+//! \param [in] start_ns Begin of span (stats_now)
+//! \param [in] arg Optional numeric argument, shown as 'process' in the viewer, -1 if none
+void
+trace_complete(const char *name, long long start_ns, long arg) {
+    struct Trace_Event *event = trace_event(name, 'X', arg);
+    if (event) {
+        event->dur_ns = event->ts_ns - start_ns;
+        event->ts_ns = start_ns;
+    }
+}
+
+//! \brief Write all recorded events in Chrome/Perfetto trace event format
+//! \param [in] filename Output file
+//! \return Returns 0 in success, -1 else
+int
+trace_write(char *filename) {
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (fd < 0) {
+        fprintf(stderr, "Can not open trace file %s\n", filename);
+        return -1;
+    }
+    int pid = getpid();
+    bool first = true;
+    dprintf(fd, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [");
+    for (struct Trace_Buffer *buffer = all_buffers.load(); buffer; buffer = buffer->next) {
+        for (struct Trace_Chunk *chunk = buffer->first; chunk; chunk = chunk->next) {
+            for (int i = 0; i < chunk->size; i++) {
+                struct Trace_Event *event = &chunk->events[i];
+                dprintf(fd, "%s\n{\"name\": \"%s\", \"ph\": \"%c\", \"ts\": %lld.%03lld, \"pid\": %d, \"tid\": %d",
+                        first ? "" : ",", event->name, event->phase, event->ts_ns / 1000, event->ts_ns % 1000,
+                        pid, buffer->tid);
+                if (event->phase == 'X') {
+                    dprintf(fd, ", \"dur\": %lld.%03lld", event->dur_ns / 1000, event->dur_ns % 1000);
+                }
+                if (event->arg >= 0) {
+                    dprintf(fd, ", \"args\": {\"%s\": %ld}", (event->phase == 'X') ? "process" : "nodes", event->arg);
+                }
+                dprintf(fd, "}");
+                first = false;
+            }
+        }
+    }
+    dprintf(fd, "\n]}\n");
+    close(fd);
+    return 0;
+}
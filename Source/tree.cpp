@@ -5,11 +5,19 @@
 #include <cmath>
 #include <string.h>
 #include <algorithm>
+#include <unordered_set>
+#include <vector>
 
 #include "tree.h"
 #include "in_and_out.h"
+#include "stats.h"
+#include "trace.h"
+#include "rewrite.h"
+#include "poly.h"
+#include "symbols.h"
+#include "taylor.h"
+#include "tree_cache.h"
 
-int Node::id = 0;
 constexpr double EPS = 1e-7;
 
 //! \brief Check for equality of two values
@@ -22,97 +30,11 @@ is_eq(double val1, double val2) {
 //! \brief Node constructor for operations
 //! \param [in] _operation Operation identificator
 Node::Node(int _operation) {
-    children_number = 0;
-    node_id = id;
-    id++;
-    childs = NULL;
+    init_childs();
+    STAT_INC(NODES_CREATED);
     parent = NULL;
     operation = _operation;
-    name_len = 1;
-    name = (char *) calloc(name_len, sizeof(char));
-    switch (operation) {
-        case MUL:
-            strncpy(name, "*", name_len);
-            break;
-        case DIV:
-            strncpy(name, "/", name_len);
-            break;
-        case SUB:
-            strncpy(name, "-", name_len);
-            break;
-        case ADD:
-            strncpy(name, "+", name_len);
-            break;
-        case POWER:
-            strncpy(name, "^", name_len);
-            break;
-        case LN:
-            name_len = 2;
-            name = (char *)realloc(name, name_len * sizeof(char));
-            strncpy(name, "ln", name_len);
-            break;
-        case COS:
-            name_len = 3;
-            name = (char *)realloc(name, name_len * sizeof(char));
-            strncpy(name, "cos", name_len);
-            break;
-        case SIN:
-            name_len = 3;
-            name = (char *)realloc(name, name_len * sizeof(char));
-            strncpy(name, "sin", name_len);
-            break;
-        case VAR:
-            strncpy(name, "x", name_len);
-            break;
-        case ASSIGNMENT:
-            strncpy(name, "=", name_len);
-            break;
-        case MORE:
-            strncpy(name, ">", name_len);
-            break;
-        case LESS:
-            strncpy(name, "<", name_len);
-            break;
-        case EQ:
-            strncpy(name, "~", name_len);
-            break;
-        case IF:
-            name_len = 2;
-            name = (char *)realloc(name, name_len * sizeof(char));
-            strncpy(name, "if", name_len);
-            break;
-        case WHILE:
-            name_len = 5;
-            name = (char *)realloc(name, name_len * sizeof(char));
-            strncpy(name, "while", name_len);
-            break;
-        case FOR:
-            name_len = 3;
-            name = (char *)realloc(name, name_len * sizeof(char));
-            strncpy(name, "for", name_len);
-            break;
-        case DO_IN_ORDER:
-            name_len = 2;
-            name = (char *)realloc(name, name_len * sizeof(char));
-            strncpy(name, "do", name_len);
-            break;
-        case FUNC_CALL:
-            strncpy(name, "?", name_len);
-            break;
-        case FUNC_DEF:
-            strncpy(name, "?", name_len);
-            break;
-        case RETURN:
-            name_len = 6;
-            name = (char *)realloc(name, name_len * sizeof(char));
-            strncpy(name, "return", name_len);
-            break;
-        default:
-            name_len = 0;
-            free(name);
-            name = NULL;
-            break;
-    }
+    name_id = (operation == CONSTANT) ? SYMBOL_NONE : operation; // operation names are static symbols
 }
 
 
@@ -130,35 +52,85 @@ Node::change_operation(int _operation) {
 //! \brief Node constructor for vars (to make possible different vars)
 //! \param [in] _operation Operation identificator
 //! \param [in] _name Oprator name
-Node::Node(int _operation, char *_name) {
-    children_number = 0;
-    node_id = id;
-    id++;
-    childs = NULL;
+Node::Node(int _operation, const char *_name) : Node(_operation, intern_symbol(_name)) {
+}
+
+//! \brief Node constructor for vars with already interned name
+//! \param [in] _operation Operation identificator
+//! \param [in] _name_id Symbol id of the name
+Node::Node(int _operation, int _name_id) {
+    init_childs();
+    STAT_INC(NODES_CREATED);
     parent = NULL;
     operation = _operation;
-    name_len = strlen(_name);
-    name = (char *)calloc(name_len + 1, sizeof(char *));
-    strncpy(name, _name, name_len + 1);
+    name_id = _name_id;
 }
 
 //! \brief Node constructor for constants
 //! \param [in] _value Value for constant
 Node::Node(double _value) {
-    children_number = 0;
-    node_id = id;
-    id++;
-    childs = NULL;
+    init_childs();
+    STAT_INC(NODES_CREATED);
     parent = NULL;
     operation = CONSTANT;
     value = _value;
-    name_len = 0;
-    name = NULL;
+    name_id = SYMBOL_NONE;
 }
 
 //! \brief Node destructor
 Node::~Node() {
-    free(childs);
+    STAT_INC(NODES_FREED);
+    if (childs != inline_childs) {
+        free(childs);
+    }
+}
+
+//! \brief Make empty children store, which uses the inline buffer
+void
+Node::init_childs() {
+    children_number = 0;
+    children_capacity = NODE_INLINE_CHILDREN;
+    childs = inline_childs;
+}
+
+//! \brief Make place for children, capacity grows geometrically, so adding of
+//! n children makes O(log n) allocations
+//! \param [in] number Number of children to store
+//! \return Returns 0 in success -1 else
+int
+Node::reserve_children(int number) {
+    if (number <= children_capacity) {
+        return 0;
+    }
+    int capacity = children_capacity;
+    while (capacity < number) {
+        capacity *= 2;
+    }
+    Node **tmp = NULL;
+    if (childs == inline_childs) {
+        tmp = (Node **)malloc(capacity * sizeof(*tmp));
+        if (tmp) {
+            memcpy(tmp, childs, children_number * sizeof(*tmp));
+        }
+    } else {
+        tmp = (Node **)realloc(childs, capacity * sizeof(*tmp));
+    }
+    if (!tmp) {
+        fprintf(stderr, "Memory Allocation Error during reserve_children\n");
+        return -1;
+    }
+    childs = tmp;
+    children_capacity = capacity;
+    return 0;
+}
+
+//! \brief Delete all children subtrees, memory for them is kept
+void
+Node::clear_children() {
+    for (int i = 0; i < children_number; i++) {
+        rec_del(childs[i]);
+    }
+    children_number = 0;
 }
 
 //! \brief Value getter
@@ -189,7 +161,7 @@ Node::visualize(int fd) {
     if (operation == CONSTANT) {
         dprintf(fd, "%lf", value);
     } else {
-        dprintf(fd, "%s", name);
+        dprintf(fd, "%s", symbol_name(name_id));
     }
     return 0;
 }
@@ -231,59 +203,149 @@ calculate(int operation, double *res, double operand) {
     }
     return;
 }
+//! \brief Fill color of operation node in dot
+static const char *
+dot_color(int operation) {
+    switch(operation) {
+        case VAR:
+            return "green";
+        case FUNC_CALL:
+            return "blue";
+        case FUNC_DEF:
+            return "pink";
+        case RETURN:
+            return "red";
+        case FOR:
+        case WHILE:
+        case IF:
+            return "lightgrey";
+        default:
+            return "darkgrey";
+    }
+}
+
 //! \brief Recursive function for tree visualization generation
 //! \param [in] fd File descriptor
+//! \param [in,out] next_id Id of the node in the graph, nodes are numbered in
+//! preorder, so the graph depends only on the tree
 //! \return Returns counted value
 double
-Node::visualize_tree_rec(int fd) {
-    dprintf(fd, "%d [style = filled, label=\"", node_id);
+Node::visualize_tree_rec(int fd, int *next_id) {
+    int dot_id = (*next_id)++;
+    dprintf(fd, "%d [style = filled, label=\"", dot_id);
     visualize(fd);
     double res = 0;
     if (operation) {
-        dprintf(fd, "\", shape = box, fillcolor=");
-        switch(operation) {
-            case VAR:
-                dprintf(fd, "\"green\"");
-                break;
-            case FUNC_CALL:
-                dprintf(fd, "\"blue\"");
-                break;
-            case FUNC_DEF:
-                dprintf(fd, "\"pink\"");
-                break;
-            case RETURN:
-                dprintf(fd, "\"red\"");
-                break;
-            case FOR:
-            case WHILE:
-            case IF:
-                dprintf(fd, "\"lightgrey\"");
-                break;
-            default:
-                dprintf(fd, "\"darkgrey\"");
-                break;
-        }
-        dprintf(fd, "];\n");
+        dprintf(fd, "\", shape = box, fillcolor=\"%s\"];\n", dot_color(operation));
     } else {
         res = value;
         dprintf(fd, "\", fillcolor=\"yellow\"];\n");
         return res;
     }
     for (int i = 0; i < get_children_number(); i++) {
-        dprintf(fd, "%d->%d;\n", node_id, childs[i]->node_id);
+        dprintf(fd, "%d->%d;\n", dot_id, *next_id);
         if (i) {
-            calculate(operation, &res, childs[i]->visualize_tree_rec(fd));
+            calculate(operation, &res, childs[i]->visualize_tree_rec(fd, next_id));
         } else {
             if (operation == SIN || operation == COS || operation == LN) {
-                calculate(operation, &res, childs[i]->visualize_tree_rec(fd));
+                calculate(operation, &res, childs[i]->visualize_tree_rec(fd, next_id));
             } else {
-                res = childs[i]->visualize_tree_rec(fd);
+                res = childs[i]->visualize_tree_rec(fd, next_id);
             }
         }
     }
     return res;
 }
 
+//! \brief Nodes, collapsed by level of detail, path of the current node and
+//! id of the next drawn node
+struct Lod_State {
+    std::unordered_set<Node *> collapsed;
+    std::string path;
+    int next_id;
+};
+
+//! \brief Recursive function for tree visualization with level of detail:
+//! collapsed subtree is one node with operation, size and path for drill-down
+//! \param [in] fd File descriptor
+//! \param [in] state Collapsed nodes and path of this node
+//! \return Returns counted value
+double
+Node::visualize_tree_lod(int fd, struct Lod_State *state) {
+    if (!state->collapsed.count(this)) {
+        if (!children_number) {
+            return visualize_tree_rec(fd, &state->next_id);
+        }
+        int dot_id = state->next_id++;
+        dprintf(fd, "%d [style = filled, label=\"", dot_id);
+        visualize(fd);
+        dprintf(fd, "\", shape = box, fillcolor=\"%s\"];\n", dot_color(operation));
+        double res = 0;
+        for (int i = 0; i < children_number; i++) {
+            size_t path_len = state->path.size();
+            state->path += (path_len ? "." : "") + std::to_string(i);
+            dprintf(fd, "%d->%d;\n", dot_id, state->next_id);
+            double child = childs[i]->visualize_tree_lod(fd, state);
+            if (i || operation == SIN || operation == COS || operation == LN) {
+                calculate(operation, &res, child);
+            } else {
+                res = child;
+            }
+            state->path.resize(path_len);
+        }
+        return res;
+    }
+    dprintf(fd, "%d [style = filled, shape = folder, fillcolor=\"lightblue\", label=\"", state->next_id++);
+    visualize(fd);
+    dprintf(fd, "\\n%ld nodes\\npath %s\"];\n", get_size(), state->path.empty() ? "-" : state->path.c_str());
+    return is_constant() ? get_val() : 0;
+}
+
+//! \brief Find nodes to collapse: levels are opened breadth first, while they
+//! fit into the depth and node budget, so the top of the tree is always shown
+//! \param [in] root Root of exported tree
+//! \param [in] lod Level of detail
+//! \param [out] collapsed Nodes with hidden children
+static void
+lod_collapse(Node *root, const struct Dot_Lod *lod, std::unordered_set<Node *> *collapsed) {
+    std::vector<std::pair<Node *, int>> queue(1, std::make_pair(root, 0));
+    long shown = 1;
+    for (size_t i = 0; i < queue.size(); i++) {
+        Node *node = queue[i].first;
+        int depth = queue[i].second;
+        int children = node->get_children_number();
+        if (!children) {
+            continue;
+        }
+        if ((lod->max_depth && depth >= lod->max_depth) || (lod->max_nodes && shown + children > lod->max_nodes)) {
+            collapsed->insert(node);
+            continue;
+        }
+        shown += children;
+        for (int j = 0; j < children; j++) {
+            queue.push_back(std::make_pair(node->get_childs()[j], depth + 1));
+        }
+    }
+}
+
+//! \brief Find subtree by path of child indexes from this node
+//! \param [in] path Indexes, separated by '.' ("0.2.1"), NULL or "" for this node
+//! \return Returns subtree or NULL, if there is no such path
+Node *
+Node::find_path(const char *path) {
+    Node *node = this;
+    while (path && *path) {
+        char *end = NULL;
+        long ind = strtol(path, &end, 10);
+        if (end == path || ind < 0 || ind >= node->children_number || (*end && *end != '.')) {
+            return NULL;
+        }
+        node = node->childs[ind];
+        path = *end ? end + 1 : end;
+    }
+    return node;
+}
+
 //! \brief childs getter
 //! \return Returns pointer to pointers to childs
 Node **
@@ -292,9 +354,11 @@ Node::get_childs() {
 }
 //! \brief Writes tree description in dot-readable format
 //! \param [in] fd File descriptor
+//! \param [in] graph_name Name of graph, NULL for G
+//! \param [in] lod Level of detail (this node is the root of lod->path), NULL to draw all nodes
 //! \return Returns 0 in success, -1 else
 int
-Node::export_dot(int fd, char *graph_name) {
+Node::export_dot(int fd, char *graph_name, const struct Dot_Lod *lod) {
     assert(fd >= 0);
 
     dprintf(fd, "digraph ");
@@ -303,7 +367,18 @@ Node::export_dot(int fd, char *graph_name) {
     } else {
         dprintf(fd, "G {\n");
     }
-    double res = visualize_tree_rec(fd);
+    expand_lazy();
+    double res = 0;
+    if (lod) {
+        struct Lod_State state;
+        lod_collapse(this, lod, &state.collapsed);
+        state.path = lod->path ? lod->path : "";
+        state.next_id = 0;
+        res = visualize_tree_lod(fd, &state);
+    } else {
+        int next_id = 0;
+        res = visualize_tree_rec(fd, &next_id);
+    }
     if (is_constant()) {
         dprintf(fd, "\"result=%lf\" [shape=box];", res);
     }
@@ -367,15 +442,20 @@ Node::visualize_tree_rec_tex(int fd) {
 
 //! \brief Writes tree desription in tex format
 //! \param [in] fd File decriptor
+//! \param [in] end Finish the document, false to write more formulas after
 //! \return Return 0 in success, -1 else
-int Node::export_tex(int fd) {
+int Node::export_tex(int fd, bool end) {
     assert(fd >= 0);
+    expand_lazy();
     dprintf(fd, "$$ ");
     double res = visualize_tree_rec_tex(fd);
     if (is_constant()) {
         dprintf(fd, " = %lf ", res);
     }
-    dprintf(fd, "$$ \n \\end");
+    dprintf(fd, "$$ \n");
+    if (end) {
+        dprintf(fd, " \\end");
+    }
     return 0;
 }
 
@@ -384,18 +464,76 @@ int Node::export_tex(int fd) {
 //! \return Returns 0 in success -1 else
 int
 Node::add_child(Node *child) {
-    children_number++;
-    Node **tmp = (Node **)realloc(childs, children_number * sizeof(*tmp));
-    if (!tmp) {
-        fprintf(stderr, "Memory Allocation Error during add_child\n");
+    if (reserve_children(children_number + 1)) {
         return -1;
     }
-    childs = tmp;
-    childs[children_number - 1] = child;
+    childs[children_number++] = child;
     child->parent = this;
     return 0;
 }
 
+//! \brief Put other node on the place of child
+//! \param [in] child_ind Child index
+//! \param [in] child New child
+//! \return Returns old child (without parent) or NULL, if index is wrong
+Node *
+Node::replace_child(int child_ind, Node *child) {
+    if (child_ind < 0 || child_ind >= children_number) {
+        return NULL;
+    }
+    Node *old = childs[child_ind];
+    old->parent = NULL;
+    childs[child_ind] = child;
+    child->parent = this;
+    return old;
+}
+
+//! \brief Move all children of other node to this one, they are inserted
+//! before child pos in the same order. Other node is left without children
+//! \param [in] pos Index of insertion, children_number to append
+//! \param [in] other Node to take children from
+//! \return Returns 0 in success -1 else
+int
+Node::splice_children(int pos, Node *other) {
+    if (pos < 0 || pos > children_number || other == this) {
+        return -1;
+    }
+    int num = other->children_number;
+    if (reserve_children(children_number + num)) {
+        return -1;
+    }
+    memmove(childs + pos + num, childs + pos, (children_number - pos) * sizeof(*childs));
+    for (int i = 0; i < num; i++) {
+        childs[pos + i] = other->childs[i];
+        childs[pos + i]->parent = this;
+    }
+    children_number += num;
+    other->children_number = 0;
+    return 0;
+}
+
+//! \brief Delete children, selected by cut, in one pass: the rest are moved
+//! to the front in the same order
+//! \param [in] cut Returns true for child to delete, it gets the child before
+//! deletion, its index and arg
+//! \param [in] arg Argument for cut
+//! \param [in] first Children before it are kept without check
+//! \return Returns number of deleted children
+int
+Node::remove_children(bool (*cut)(Node *child, int child_ind, void *arg), void *arg, int first) {
+    int num = first;
+    for (int i = first; i < children_number; i++) {
+        if (cut(childs[i], i, arg)) {
+            rec_del(childs[i]);
+        } else {
+            childs[num++] = childs[i];
+        }
+    }
+    int removed = children_number - num;
+    children_number = num;
+    return removed;
+}
+
 //! \brief Skip space symbols
 //! \param [in,out] begin Begining of the symbols. Is shifted to the first non-space value
 //! \param [in] end First incorrect symbol
@@ -419,6 +557,55 @@ rec_del(Node *root) {
     return;
 }
 
+//! \brief Structural equality with constant values and names (tree_eq does not compare values)
+//! \return Returns true, if trees are equal
+bool
+tree_same(Node *first, Node *second) {
+    if (first->get_operation() != second->get_operation() ||
+        first->get_children_number() != second->get_children_number()) {
+        return false;
+    }
+    if (first->get_operation() == CONSTANT) {
+        // the same bits, as inf and nan are not is_eq to themselves
+        double value1 = first->get_value(), value2 = second->get_value();
+        return is_eq(value1, value2) || !memcmp(&value1, &value2, sizeof(value1));
+    }
+    if (first->get_name_id() != second->get_name_id()) {
+        return false;
+    }
+    for (int i = 0; i < first->get_children_number(); i++) {
+        if (!tree_same(first->get_childs()[i], second->get_childs()[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//! \brief Hash of the tree structure, names and constant values, equal
+//! (in terms of tree_same) trees have equal hashes, if constants are exactly equal
+//! \param [out] size Number of nodes, may be NULL
+//! \return Returns hash
+unsigned long long
+tree_hash(Node *root, long *size) {
+    unsigned long long hash = root->get_operation() * 1000003ULL ^ root->get_name_id();
+    if (root->get_operation() == CONSTANT) {
+        long long bits = 0;
+        double value = root->get_value();
+        memcpy(&bits, &value, sizeof(bits));
+        hash = hash * 1000003ULL ^ bits;
+    }
+    long nodes = 1;
+    for (int i = 0; i < root->get_children_number(); i++) {
+        long child_size = 0;
+        hash = hash * 1000003ULL ^ tree_hash(root->get_childs()[i], &child_size);
+        nodes += child_size;
+    }
+    if (size) {
+        *size = nodes;
+    }
+    return hash;
+}
+
 //! \brief Recognize operation
 //! \param [in,out] operation Operation to recognize
 //! \return Return operation identificator
@@ -570,9 +757,7 @@ parse_rec(char **begin, char *end) {
             fprintf(stderr, "Wrong input file format: can not recoginse var name %s\n", *begin);
             return NULL;
         }
-        char *name = (char *)calloc(name_len + 1, sizeof(char));
-        strncpy(name, *begin, name_len);
-        Node *parent = new Node(VAR, name);
+        Node *parent = new Node(VAR, intern_symbol(*begin, name_len));
         (*begin) += name_len; // name
         skip(begin, end);
         (*begin)++;
@@ -598,26 +783,31 @@ parse_file_create_tree(char *filename) {
         fprintf(stderr, "Can not mmap input file %s\n", filename);
         return NULL;
     }
-    char *old_exp = exp;
-    Node *root = parse_rec(&exp, exp + file_size);
-    munmap(old_exp, file_size);
+    Node *root = parse_str_create_tree(exp, file_size);
+    munmap(exp, file_size);
     return root;
 }
 
+//! \brief Create tree from expression in memory
+//! \param [in] str Expression in full-parenthesis format
+//! \param [in] str_size Expression length
+//! \return Returns root of created tree or NULL if unsuccess
+Node *
+parse_str_create_tree(char *str, int str_size) {
+    return parse_rec(&str, str + str_size);
+}
+
 //! \brief Copy tree
 //! \return Returns root of the copied tree
 Node *
 Node::copy() {
     Node *root = NULL;
     if (operation) {
-        if (name) {
-            root = new Node(operation, name);
-        } else {
-            root = new Node(operation);
-        }
+        root = new Node(operation, name_id);
     } else {
         root = new Node(value);
     }
+    root->reserve_children(children_number);
     for (int i = 0; i < children_number; i++) {
         root->add_child(childs[i]->copy());
     }
@@ -625,6 +815,17 @@ Node::copy() {
 }
 
 
+//! \brief Count nodes in the subtree
+//! \return Returns number of nodes, including this one
+long
+Node::get_size() {
+    long res = 1;
+    for (int i = 0; i < children_number; i++) {
+        res += childs[i]->get_size();
+    }
+    return res;
+}
+
 //! \brief Find, if the expression is constant (can be calculated). It means no VAR nodes
 //! \return Returns true, if no VAR nodes, false else
 bool
@@ -643,17 +844,90 @@ Node::is_constant() {
 //! \brief Create new tree with derivate of old tree
 //! \return Returns root of the new tree
 Node *
-Node::derivate(char *var_name) {
+Node::derivate(const char *var_name) {
+    return derivate(intern_symbol(var_name));
+}
+
+//! \brief Create new simplified tree with derivate of the given order,
+//! derivates of subtrees are reused between orders (see taylor.cpp)
+//! \param [in] var_name Name of the variable
+//! \param [in] order Order of the derivate
+//! \return Returns root of the new tree
+Node *
+Node::derivate(const char *var_name, int order) {
+    return derivate_order(this, intern_symbol(var_name), order);
+}
+
+//! \brief Create lazy derivate: the tree is built only when it is visited by
+//! simplify, export or evaluation (see expand_lazy)
+//! \param [in] var_id Symbol id of the variable
+//! \return Returns root of the new tree
+Node *
+Node::derivate_lazy(int var_id) {
+    if (operation == CONSTANT || operation == VAR) {
+        return derivate(var_id);
+    }
+    Node *root = new Node(DERIVATE, var_id);
+    root->add_child(copy());
+    return root;
+}
+
+//! \brief Check, if the subtree depends on the variable
+static bool
+depends_on(Node *node, int var_id) {
+    if (node->get_operation() == VAR) {
+        return node->get_name_id() == var_id;
+    }
+    for (int i = 0; i < node->get_children_number(); i++) {
+        if (depends_on(node->get_childs()[i], var_id)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+//! \brief Expand all lazy derivates in the subtree, the results replace them
+void
+Node::expand_lazy() {
+    if (operation == DERIVATE) {
+        replace_by(childs[0]->derivate(name_id));
+        STAT_INC(LAZY_EXPANDED);
+    }
+    for (int i = 0; i < children_number; i++) {
+        childs[i]->expand_lazy();
+    }
+}
+
+//! \brief Expand lazy derivate for simplify: the operand is simplified first,
+//! so rules are applied to a smaller tree, and the derivate of subtree without
+//! the variable is not built at all
+void
+Node::expand_simplified() {
+    while (operation == DERIVATE) {
+        childs[0]->simplify();
+        if (depends_on(childs[0], name_id)) {
+            replace_by(childs[0]->derivate(name_id));
+            STAT_INC(LAZY_EXPANDED);
+        } else {
+            replace_by(new Node(0.0));
+            STAT_INC(LAZY_SKIPPED);
+        }
+    }
+}
+
+//! \brief Create new tree with derivate of old tree
+//! \param [in] var_id Symbol id of the variable
+//! \return Returns root of the new tree
+Node *
+Node::derivate(int var_id) {
     Node *root = NULL;
     Node *tmp = NULL;
-    int var_name_len = 0;
     switch (operation) {
         case CONSTANT:
             root = new Node(0.0);
             break;
         case VAR:
-            var_name_len = strlen(var_name);
-            if ((var_name_len != name_len) || strncmp(name, var_name, var_name_len)) {
+            if (name_id != var_id) {
                 root = new Node(0.0);
                 break;
             }
@@ -662,13 +936,13 @@ Node::derivate(char *var_name) {
         case ADD:
             root = new Node(ADD); // (a + b + c)` = a` + b` + c`
             for (int i = 0; i < children_number; i++) {
-                root->add_child(childs[i]->derivate(var_name));
+                root->add_child(childs[i]->derivate(var_id));
             }
             break;
         case SUB:
             root = new Node(SUB); // (a - b - c)` = a` - b` - c`
             for (int i = 0; i < children_number; i++) {
-                root->add_child(childs[i]->derivate(var_name));
+                root->add_child(childs[i]->derivate(var_id));
             }
             break;
         case MUL:
@@ -676,7 +950,7 @@ Node::derivate(char *var_name) {
             for (int i = 0; i < children_number; i++) {
                 root->add_child(new Node(MUL));
                 for (int j = 0; j < children_number; j++) {
-                    root->childs[i]->add_child((i == j) ? (childs[j]->derivate(var_name)) : (childs[j]->copy()));
+                    root->childs[i]->add_child((i == j) ? (childs[j]->derivate(var_id)) : (childs[j]->copy()));
                 }
             }
             break;
@@ -695,11 +969,11 @@ Node::derivate(char *var_name) {
             root->add_child(new Node(SUB)); // see above: (a` * b) - (a * b`)
             root->childs[0]->add_child(new Node(MUL)); // a` * b
             root->childs[0]->add_child(new Node(MUL)); // a * b`
-            root->childs[0]->childs[0]->add_child(tmp->derivate(var_name)); // a`
+            root->childs[0]->childs[0]->add_child(tmp->derivate(var_id)); // a`
             root->childs[0]->childs[0]->add_child(childs[children_number - 1]->copy()); // b
             root->childs[0]->childs[1]->add_child(tmp->copy()); // a
-            root->childs[0]->childs[1]->add_child(childs[children_number - 1]->derivate(var_name)); // b`
-            delete tmp;
+            root->childs[0]->childs[1]->add_child(childs[children_number - 1]->derivate(var_id)); // b`
+            rec_del(tmp);
             tmp = NULL; // may be better make b ^ 2? 
             root->add_child(new Node(MUL)); // (b * b)
             root->childs[1]->add_child(childs[children_number - 1]->copy()); // b
@@ -710,7 +984,7 @@ Node::derivate(char *var_name) {
             if (children_number > 2) {
                 tmp = new Node(POWER);
                 for (int i = 0; i < children_number - 1; i++) {
-                    tmp->add_child(childs[i]);
+                    tmp->add_child(childs[i]->copy());
                 }
             } else {
                 tmp = childs[0]->copy();
@@ -722,7 +996,8 @@ Node::derivate(char *var_name) {
 
                 root->add_child(copy()); // C ^ x
                 
-                root->add_child(childs[children_number - 1]->derivate(var_name));
+                root->add_child(childs[children_number - 1]->derivate(var_id));
+                rec_del(tmp);
                 break;
             }
             if (childs[children_number - 1]->is_constant()) { // (x ^ C)` = C * (x ^ (C - 1)) * x`
@@ -735,7 +1010,8 @@ Node::derivate(char *var_name) {
                 root->childs[1]->childs[1]->add_child(childs[children_number - 1]->copy()); // C
                 root->childs[1]->childs[1]->add_child(new Node(1.0)); // 1
 
-                root->add_child(tmp->derivate(var_name)); // x`
+                root->add_child(tmp->derivate(var_id)); // x`
+                rec_del(tmp);
                 break;
             }
             // (f(x) ^ g(x))` = (f ^ g) * (g` * ln(f) + g / f * f`) = 
@@ -744,7 +1020,7 @@ Node::derivate(char *var_name) {
 
             root->add_child(new Node(MUL)); // *
             root->childs[0]->add_child(copy()); // f ^ g
-            root->childs[0]->add_child(childs[children_number - 1]->derivate(var_name)); // g`
+            root->childs[0]->add_child(childs[children_number - 1]->derivate(var_id)); // g`
             root->childs[0]->add_child(new Node(LN)); // ln
             root->childs[0]->childs[2]->add_child(tmp->copy()); // ln f
 
@@ -756,9 +1032,9 @@ Node::derivate(char *var_name) {
             root->childs[1]->childs[0]->childs[1]->add_child(childs[children_number - 1]->copy()); // g
             root->childs[1]->childs[0]->childs[1]->add_child(new Node(1.0)); // 1
             
-            root->childs[1]->add_child(tmp->copy()); // g
-            root->childs[1]->add_child(childs[children_number - 1]->derivate(var_name)); // f`
-            
+            root->childs[1]->add_child(childs[children_number - 1]->copy()); // g
+            root->childs[1]->add_child(tmp->derivate(var_id)); // f`
+            rec_del(tmp);
             break;
         case LN: // (ln x)` = (1 / x) * x`
             root = new Node(MUL);
@@ -766,20 +1042,25 @@ Node::derivate(char *var_name) {
             root->childs[0]->add_child(new Node(1.0)); // 1
             root->childs[0]->add_child(childs[0]->copy()); // x
             
-            root->add_child(childs[0]->derivate(var_name)); // x`
+            root->add_child(childs[0]->derivate(var_id)); // x`
             break;
         case SIN: // (sin x)` = (cos x) * x`
             root = new Node(MUL);
             root->add_child(new Node(COS)); // cos
             root->childs[0]->add_child(childs[0]->copy()); // x
-            root->add_child(childs[0]->derivate(var_name)); // x`
+            root->add_child(childs[0]->derivate(var_id)); // x`
             break;
         case COS: // (cos x)` = - sin(x) * x` = (-1) * sin (x) * x`
             root = new Node(MUL);
             root->add_child(new Node(-1.0));
             root->add_child(new Node(SIN)); // sin
             root->childs[1]->add_child(childs[0]->copy()); // x
-            root->add_child(childs[0]->derivate(var_name)); // x`
+            root->add_child(childs[0]->derivate(var_id)); // x`
+            break;
+        case DERIVATE: // (f`)` = derivate of the expanded f`
+            tmp = childs[0]->derivate(name_id);
+            root = tmp->derivate(var_id);
+            rec_del(tmp);
             break;
         default:
             fprintf(stderr, "Derivate error: unknown operation %d\n", operation);
@@ -809,6 +1090,9 @@ Node::get_val() {
     if (operation == COS) {
         return cos(childs[0]->get_val());
     }
+    if (operation == DERIVATE) { // is constant, as there are no VAR nodes
+        return 0;
+    }
     // from this place all operations have two and more operands
     res = childs[0]->get_val();   
     for (int i = 1; i < children_number; i++) {
@@ -822,24 +1106,48 @@ Node::get_val() {
 //! \return Returns cutted child
 Node *
 Node::cut_child(int child_ind) {
-    if (child_ind < 0 || child_ind > children_number) {
+    if (child_ind < 0 || child_ind >= children_number) {
         return NULL;
     }
     Node *cutted = childs[child_ind];
     cutted->parent = NULL;
-    for (int i = child_ind; i < children_number - 1; i++) {
-        childs[i] = childs[i + 1];
-    }
-    children_number--; // now have more memory, than necessary for this number of childs
-    Node **tmp = (Node **)realloc(childs, sizeof(*tmp) * children_number);
-    if (children_number && !tmp) {
-        fprintf(stderr, "Memory reallocation error in cut_child for child_ind %d\n", child_ind);
-        return cutted; // Do not break *this
-    } 
-    childs = tmp;
+    memmove(childs + child_ind, childs + child_ind + 1, (children_number - child_ind - 1) * sizeof(*childs));
+    children_number--; // memory is kept for the next add_child
     return cutted;
 }
 
+//! \brief Replace this node by other tree. Parent keeps pointer to this node,
+//! other node shell is deleted
+//! \param [in] other Root of the new subtree, must not be a part of this subtree
+void
+Node::replace_by(Node *other) {
+    clear_children();
+    if (other->childs == other->inline_childs) {
+        splice_children(0, other);
+    } else { // heap array is taken as is
+        if (childs != inline_childs) {
+            free(childs);
+        }
+        children_number = other->children_number;
+        children_capacity = other->children_capacity;
+        childs = other->childs;
+        other->init_childs();
+    }
+    operation = other->operation;
+    value = other->value;
+    name_id = other->name_id;
+    for (int i = 0; i < children_number; i++) {
+        childs[i]->parent = this;
+    }
+    delete other;
+}
+
+//! \brief remove_children filter: constant equal to *(double *)arg
+static bool
+is_value(Node *child, int, void *arg) {
+    return child->get_operation() == CONSTANT && is_eq(*(double *)arg, child->get_value());
+}
+
 //! \brief Remove neitral elements
 void
 Node::remove_neitrals() {
@@ -848,123 +1156,32 @@ Node::remove_neitrals() {
     }
     int ind = (operation == SUB || operation == DIV || operation == POWER) ? 1 : 0;
     double neitral = get_neitral(operation);
-    Node *tmp = NULL;
-    while (ind < children_number) {
-        if (childs[ind]->operation == CONSTANT && is_eq(neitral, childs[ind]->value)) {
-            free(cut_child(ind));
-        } else {
-            ind++; 
-        } 
+    if (remove_children(is_value, &neitral, ind)) {
+        STAT_INC(RULE_REMOVE_NEITRALS);
     }
     if (!children_number) { // all childs were neitral elements
         operation = CONSTANT;
         value = neitral;
-        free(name);
-        name = NULL;
-        name_len = 0;
+        name_id = SYMBOL_NONE;
         return;
     }
     if (children_number == 1) { // only one childs is alive
-        tmp = cut_child(0);
-        operation = tmp->operation;
-        free(name);
-        name = tmp->name;
-        name_len = tmp->name_len;
-        int children_number_old = tmp->children_number;
-        for (int i = 0; i < children_number_old; i++) {
-            add_child(tmp->cut_child(0));
-        }
-        value = tmp->value;
-        free(tmp);
-    }
-    return;
-}
-
-//! \brief Some algebraic rules
-void
-Node::specific_simpling() {
-    if (operation == DIV) {
-        if (childs[0]->operation == CONSTANT && is_eq(0.0, childs[0]->value)) {
-// 0 / ... = 0 (if ... = 0, expression is illegal)
-            int children_number_old = children_number;
-            for (int i = 0; i < children_number_old; i++) {
-                rec_del(cut_child(0));
-            }
-            operation = CONSTANT;
-            free(name);
-            name = NULL;
-            name_len = 0;
-            value = 0.0;
-        }
-        return;
-    }    
-    if (operation == MUL) {
-        for (int i = 0; i < children_number; i++) {
-            if (childs[i]->operation == CONSTANT && is_eq(0.0, childs[i]->value)) {
-// 0 * x = 0
-                int children_number_old = children_number;
-                for (int j = 0; j < children_number_old; j++) {
-                    rec_del(cut_child(0));
-                }
-                operation = CONSTANT;
-                free(name);
-                name = NULL;
-                name_len = 0;
-                value = 0.0;
-                return;
-            }
-
-        }
-    }
-
-    if (operation == POWER) {
-        if (childs[0]->operation == CONSTANT && is_eq(0.0, childs[0]->value)) {
-// 0 ^ x = 0
-            int children_number_old = children_number;
-            for (int i = 0; i < children_number_old; i++) {
-                rec_del(cut_child(0));
-            }
-            operation = CONSTANT;
-            name_len = 0;
-            free(name);
-            name = NULL;
-            value = 0.0;
-            return;
-        }
-        for (int i = 1; i < children_number; i++) {
-            if (childs[i]->operation == CONSTANT && is_eq(0.0, childs[i]->value)) {
-                // x ^ 0 = 1
-                int children_number_old = children_number;
-                for (int j = 0; j < children_number_old; j++) {
-                    rec_del(cut_child(0));
-                }
-                operation = CONSTANT;
-                free(name);
-                name = NULL;
-                name_len = 0;
-                value = 1.0;
-                return;
-            }
-        }
+        replace_by(cut_child(0));
     }
     return;
 }
 
-
-
 //! \brief If there is no VARs in the tree, value can be calculated directly
 void
 Node::calculate_values() {
     if (is_constant()) {
-        double res = get_val();
-        int children_number_old = children_number;
-        for (int i = 0; i < children_number_old; i++) {
-            rec_del(cut_child(0));
+        if (children_number) {
+            STAT_INC(RULE_CALCULATE_VALUES);
         }
+        double res = get_val();
+        clear_children();
         operation = CONSTANT;
-        free(name);
-        name = NULL;
-        name_len = 0;
+        name_id = SYMBOL_NONE;
         value = res;
     }
     return;
@@ -981,10 +1198,7 @@ Node::tree_eq(Node *other) {
     if (operation != other->operation) {
         return false;
     }
-    if (name_len != other->name_len) {
-        return false;
-    }
-    if (strncmp(name, other->name, name_len)) {
+    if (name_id != other->name_id) {
         return false;
     }
     if (children_number != other->children_number) {
@@ -1010,14 +1224,11 @@ Node::union_layers() {
             for (int i = 0; i < old_num; i++) {
                 if (childs[i]->operation == operation) {
                     tmp = childs[i];
-                    childs[i] = tmp->childs[0];
-                    childs[i]->parent = this;
-                    for (int j = 1; j < tmp->children_number; j++) {
-                        add_child(tmp->childs[j]);
-                    }
-                    free(tmp->name);
-                    free(tmp);
+                    replace_child(i, tmp->cut_child(0));
+                    splice_children(children_number, tmp);
+                    delete tmp;
                     tmp = NULL;
+                    STAT_INC(RULE_UNION_LAYERS);
                 }
             }
             return;
@@ -1026,28 +1237,21 @@ Node::union_layers() {
             for (int i = 1; i < old_num; i++) {
                 if (childs[i]->operation == ADD) {
                     tmp = childs[i];
-                    childs[i] = tmp->childs[0];
-                    childs[i]->parent = this;
-                    for (int j = 1; j < tmp->children_number; j++) {
-                        add_child(tmp->childs[j]);
-                    }
-                    free(tmp->name);
-                    free(tmp);
+                    replace_child(i, tmp->cut_child(0));
+                    splice_children(children_number, tmp);
+                    delete tmp;
                     tmp = NULL;
-                    continue;
+                    STAT_INC(RULE_UNION_LAYERS);
                 }
             }
             return;
         case POWER: // (x ^ y) ^ z = x ^ y ^ x, but x ^ (y ^ z) != x ^ y ^ z
             if (childs[0]->operation == POWER) {
                 tmp = childs[0];
-                childs[0] = tmp->childs[0];
-                tmp->childs[0]->parent = this;
-                for (int i = 1; i < tmp->children_number; i++) {
-                    add_child(tmp->childs[i]);
-                }
-                free(tmp->name);
-                free(tmp);
+                replace_child(0, tmp->cut_child(0));
+                splice_children(children_number, tmp);
+                delete tmp;
+                STAT_INC(RULE_UNION_LAYERS);
             }
         default:
             return;
@@ -1094,6 +1298,23 @@ get_opposite(int operation) {
     }
 }
 
+//! \brief Accumulator of constants for transform_constants
+struct Fold_Arg {
+    int operation;
+    double res;
+};
+
+//! \brief remove_children filter: constant, its value is accumulated
+static bool
+fold_constant(Node *child, int, void *arg) {
+    struct Fold_Arg *fold = (struct Fold_Arg *)arg;
+    if (child->get_operation() != CONSTANT) {
+        return false;
+    }
+    calculate(fold->operation, &fold->res, child->get_value());
+    return true;
+}
+
 //! \brief 1 + 1 --> 2
 void
 Node::transform_constants() {
@@ -1112,105 +1333,81 @@ Node::transform_constants() {
     if (num <= 1) {
         return;
     }
-    double res = get_neitral(operation);
-    int ind = 1;
-    int op = get_opposite(operation);
+    STAT_INC(RULE_TRANSFORM_CONSTANTS);
+    struct Fold_Arg fold = {get_opposite(operation), (double)get_neitral(operation)};
     // constants
-    while (ind < children_number) {
-        if (childs[ind]->operation == CONSTANT) {
-            calculate(op, &res, childs[ind]->value);
-            cut_child(ind);
-        } else {
-            ind++;
-        }
-    }
+    remove_children(fold_constant, &fold, 1);
     if (childs[0]->operation == CONSTANT) {
-        calculate(operation, &(childs[0]->value), res); 
+        calculate(operation, &(childs[0]->value), fold.res); 
     } else {
-        add_child(new Node(res));
+        add_child(new Node(fold.res));
     }
     return;
 }
 
-char **
+//! \brief Get different names of VAR children in order of appearance
+//! \param [out] var_num Number of names
+//! \return Returns array of symbol ids, must be freed
+int *
 Node::get_node_vars(int *var_num) {
     *var_num = 0;
-    char **var_names = NULL;
+    int *var_ids = (int *)calloc(children_number + 1, sizeof(int));
+    std::unordered_set<int> seen;
     for (int i = 0; i < children_number; i++) {
-        if (childs[i]->operation == VAR) {
-            bool flag = false;
-            for (int j = 0; j < *var_num; j++) {
-                if (!strcmp(childs[i]->name, var_names[j])) {
-                    flag = true;
-                    break;
-                }
-            }
-            if (!flag) {
-                (*var_num)++;
-                var_names = (char **)realloc(var_names, (*var_num) * sizeof(char *)); 
-                var_names[*var_num - 1] = childs[i]->name;
-            }
+        if (childs[i]->operation == VAR && seen.insert(childs[i]->name_id).second) {
+            var_ids[(*var_num)++] = childs[i]->name_id;
         }
     }
-    return var_names;
+    return var_ids;
 }
 
 
+//! \brief remove_children filter: variable with symbol id *(int *)arg
+static bool
+is_var(Node *child, int, void *arg) {
+    return child->get_operation() == VAR && child->get_name_id() == *(int *)arg;
+}
+
 //! \brief x + x --> x * 2; x - x --> x * 0; x * x --> x ^ 2;
 void
-Node::transform_vars(char *var_name) {
+Node::transform_vars(int var_id) {
    if (operation != ADD && operation != SUB && operation != MUL) {
        return;
    }
-   int var_num = 0;
    int ind = (operation == SUB) ? 1 : 0;
-   int var_name_len = strlen(var_name);
-   while (ind < children_number) {
-       if (childs[ind]->operation == VAR && childs[ind]->name_len == var_name_len && 
-               !strncmp(childs[ind]->name, var_name, var_name_len)) {
-            var_num++;
-            cut_child(ind);
-       } else {
-           ind++;
-       }
-   }  
-   if (var_num == 1 && operation != SUB) { // x - x will be later
-       add_child(new Node(VAR, var_name)); 
+   int var_num = remove_children(is_var, &var_id, ind);
+   // minuend is never removed: x - x - ... is collected into it
+   bool var_first = operation == SUB && childs[0]->operation == VAR && childs[0]->name_id == var_id;
+   if (var_num == 1 && !var_first) { // x - x will be later, a - x stays
+       add_child(new Node(VAR, var_id)); 
        return;
    }
    if (var_num == 0) {
        return;
    }
+   STAT_INC(RULE_TRANSFORM_VARS);
    Node *tmp = NULL;
    switch (operation) {
        case ADD:
            tmp = new Node(MUL);
-           tmp->add_child(new Node(VAR, var_name));
+           tmp->add_child(new Node(VAR, var_id));
            tmp->add_child(new Node((double)var_num));
            break;
        case MUL:
            tmp = new Node(POWER);
-           tmp->add_child(new Node(VAR, var_name));
+           tmp->add_child(new Node(VAR, var_id));
            tmp->add_child(new Node((double)var_num));
            break;
        case SUB: 
            tmp = new Node(MUL); // 1 - nx
-           tmp->add_child(new Node(VAR, var_name));
-           if (childs[0]->operation == VAR && childs[0]->name_len == var_name_len &&
-                   !strncmp(childs[0]->name, var_name, var_name_len)) {
+           tmp->add_child(new Node(VAR, var_id));
+           if (var_first) {
                // y - y - y
             // x - (n - 1)x = x * (2 - n)            
                tmp->add_child(new Node((double)(1 - var_num)));
-               free(childs[0]->name);
-               free(childs[0]);
-               childs[0] = tmp;
-               childs[0]->parent = this;
+               delete replace_child(0, tmp);
                if (children_number == 1) {
-                   operation = MUL;
-                   tmp = cut_child(0);
-                   add_child(tmp->childs[0]);
-                   add_child(tmp->childs[1]);
-                   free(tmp);
+                   replace_by(cut_child(0));
                }
            } else {
                tmp->add_child(new Node((double)var_num));
@@ -1219,12 +1416,7 @@ Node::transform_vars(char *var_name) {
            return;
    } 
    if (!children_number) {
-       add_child(tmp->childs[0]);
-       add_child(tmp->childs[1]);
-       operation = tmp->operation;
-       name = tmp->name;
-       name_len = tmp->name_len;
-       free(tmp);
+       replace_by(tmp);
    } else {
        add_child(tmp);
    }
@@ -1233,29 +1425,34 @@ Node::transform_vars(char *var_name) {
 }
 
 //! \brief Getter for var name
-char *
+const char *
 Node::get_name() {
-    return name;
+    return symbol_name(name_id);
 }
 
 //! \brief Getter for name len
 int 
 Node::get_name_len() {
-    return name_len;
+    return symbol_len(name_id);
+}
+
+//! \brief Getter for symbol id of the name
+int
+Node::get_name_id() {
+    return name_id;
 }
 
 //! \brief x * a
 //! \param [in] node x * a
 //! \return node == x * a
 static bool
-var_mul_coef(Node *node, char *var_name) {
-    int var_name_len = strlen(var_name);
-    if (node->get_operation() == VAR && !strncmp(node->get_name(), var_name, var_name_len)) return true;
+var_mul_coef(Node *node, int var_id) {
+    if (node->get_operation() == VAR && node->get_name_id() == var_id) return true;
     if (node->get_operation() != MUL) return false;
     if (node->get_children_number() != 2) return false;
     Node *first = node->get_childs()[0];
     Node *second = node->get_childs()[1]; 
-    if ((first->get_operation() == VAR && first->get_name_len() == var_name_len && !strncmp(first->get_name(), var_name, var_name_len) && second->get_operation() == CONSTANT) || (first->get_operation() == CONSTANT && second->get_operation() == VAR && second->get_name_len() == var_name_len && !strncmp(second->get_name(), var_name, var_name_len))) {
+    if ((first->get_operation() == VAR && first->get_name_id() == var_id && second->get_operation() == CONSTANT) || (first->get_operation() == CONSTANT && second->get_operation() == VAR && second->get_name_id() == var_id)) {
         return true;
     }
     return false;
@@ -1278,69 +1475,75 @@ get_coef(Node *node) {
     }
 }
 
+//! \brief Accumulator of coefficients for simp_var
+struct Coef_Arg {
+    int var_id;
+    double res;
+    int flag;
+    bool keep_first;
+    int first;      // index of the first term, if it is kept
+};
+
+//! \brief remove_children filter: x * a, a is accumulated
+static bool
+collect_coef(Node *child, int child_ind, void *arg) {
+    struct Coef_Arg *coef = (struct Coef_Arg *)arg;
+    if (!var_mul_coef(child, coef->var_id)) {
+        return false;
+    }
+    coef->res += get_coef(child);
+    coef->flag++;
+    if (coef->flag == 1 && coef->keep_first) {
+        coef->first = child_ind;
+        return false;
+    }
+    return true;
+}
+
 //! \brief Work with x * a + x * b etc
 // x * a + x * b = x * (a + b)
 // x * a - x * b = x * (a - b)
+// a - x * b - x * c = a - x * (b + c)
 // (x * a) / (x * b) = a / b
 // A / (x * a) / (x * b) = A / (x * x * a * b)
 void
-Node::simp_var(char *var_name) {
-    int var_name_len = strlen(var_name);
-    double res = 0;
-    int ind;
-    int flag = 0;
-    int first = -1;
+Node::simp_var(int var_id) {
+    struct Coef_Arg coef = {var_id, 0, 0, false, -1};
+    Node *term = NULL;
     switch (operation) {
-        case ADD:
-            ind = 0;
-            while (ind < children_number) {
-                if (var_mul_coef(childs[ind], var_name)) {
-                    res += get_coef(childs[ind]);
-                    flag++;
-                    if (flag == 1) {
-                        first = ind;
-                        ind++;
-                    } else {
-                        cut_child(ind);
-                    }
-                } else {
-                    ind++;
+        case SUB:
+            if (var_mul_coef(childs[0], var_id)) { // x * a - x * b = x * (a - b)
+                remove_children(collect_coef, &coef, 1);
+                if (coef.flag) {
+                    STAT_INC(RULE_SIMP_VAR);
+                    term = new Node(MUL);
+                    term->add_child(new Node(VAR, var_id));
+                    term->add_child(new Node(get_coef(childs[0]) - coef.res));
+                    rec_del(replace_child(0, term));
                 }
+                break;
             }
-            if (flag > 1) {
-                if (childs[first]->childs[0]->operation == VAR && childs[first]->childs[0]->name_len == var_name_len
-                        && !strncmp(childs[first]->childs[0]->name, var_name, var_name_len)) {
-                    childs[first]->childs[1]->value = res;
+            // subtrahends are collected as terms of sum, single term is kept
+            // as it is (a - x is not a - x * 1)
+            // fallthrough
+        case ADD:
+            coef.keep_first = true;
+            remove_children(collect_coef, &coef, operation == SUB ? 1 : 0);
+            if (coef.flag > 1) {
+                STAT_INC(RULE_SIMP_VAR);
+                term = childs[coef.first];
+                if (term->operation == VAR) {
+                    term = new Node(MUL);
+                    term->add_child(new Node(VAR, var_id));
+                    term->add_child(new Node(coef.res));
+                    delete replace_child(coef.first, term);
+                } else if (term->childs[0]->operation == VAR && term->childs[0]->name_id == var_id) {
+                    term->childs[1]->value = coef.res;
                 } else {
-                    childs[first]->childs[0]->value = res;
+                    term->childs[0]->value = coef.res;
                 }
             }
             break;
-        case SUB:
-            res = 0;
-            ind = 1;
-            while (ind < children_number) {
-                if (var_mul_coef(childs[ind], var_name)) {
-                    res += get_coef(childs[ind]);
-                    flag = true; 
-                    cut_child(ind);
-                } else {
-                    ind++;
-                }
-            }
-            if (flag) {
-               if (var_mul_coef(childs[0], var_name)) {
-                   res = get_coef(childs[ind]) - res;
-                   free(childs[0]);
-                   childs[0]->operation = MUL;
-                   childs[0]->add_child(new Node(VAR, var_name));
-                   childs[0]->add_child(new Node(res));
-               } else {
-                   add_child(new Node(MUL));
-                   childs[children_number - 1]->add_child(new Node(VAR, var_name));
-                   childs[children_number - 1]->add_child(new Node(res));
-               } 
-            }
         default:
             break;
     }
@@ -1351,26 +1554,62 @@ Node::simp_var(char *var_name) {
 void
 Node::simplify() {
     Node *old = NULL;
+    bool poly_parent = parent && is_poly_operation(parent->operation);
+    // results for subtrees, which did not change since the previous run (--watch).
+    // Only small subtrees are cached: they are simplified again on every pass of
+    // their ancestors, while every level of big ones would copy the whole tree
+    unsigned long long hash = 0;
+    Node *key = NULL;
+    if (simplify_cache) {
+        long size = 0;
+        hash = tree_hash(this, &size);
+        if (size >= TREE_CACHE_MIN_NODES && size <= TREE_CACHE_MAX_SUBTREE) {
+            Node *found = tree_cache_find(simplify_cache, hash, poly_parent, this);
+            if (found) {
+                replace_by(found->copy());
+                STAT_INC(SIMPLIFY_CACHE_HITS);
+                return;
+            }
+            key = copy();
+        }
+    }
+    // whole polynomial is normalized at once from its top node, when the rules
+    // are done, so it replaces their result only, if it is smaller
     do {
+        expand_simplified(); // polynomial normal form may leave lazy derivate on the top
         if (operation == CONSTANT || operation == VAR) {
-            return;
+            break;
         }
         for (int i = 0; i < children_number; i++) {
             childs[i]->simplify();
         }
+        STAT_INC(SIMPLIFY_ITERATIONS);
+        long size = trace_enabled ? get_size() : 0;
+        bool traced = trace_enabled && size >= trace_min_nodes;
+        if (traced) {
+            trace_begin("simplify_iteration", size);
+        }
         rec_del(old);
         old = copy();
+        while (rewrite_node(simplify_rules(), this)) {} // no rule undoes another one
         remove_neitrals();    
-        specific_simpling();
         calculate_values();
         union_layers();
         transform_constants();
         int var_num = 0;
-        char **vars = get_node_vars(&var_num);
+        int *vars = get_node_vars(&var_num);
         for (int i = 0; i < var_num; i++) {
             transform_vars(vars[i]);
             simp_var(vars[i]);
         }
-    } while (!tree_eq(old));
+        free(vars);
+        if (traced) {
+            trace_end("simplify_iteration");
+        }
+    } while (!tree_eq(old) || (is_poly_operation(operation) && !poly_parent && poly_normalize(this)));
+    rec_del(old);
+    if (key) {
+        tree_cache_put(simplify_cache, hash, poly_parent, key, copy());
+    }
     return;
 }
@@ -0,0 +1,81 @@
+#include <cstdio>
+#include <unordered_map>
+
+#include "tree.h"
+#include "tree_cache.h"
+
+//! \brief Cache of Node::simplify results, NULL if disabled (enabled by --watch)
+struct Tree_Cache *simplify_cache = NULL;
+
+struct Tree_Cache_Entry {
+    int tag;        // what else the result depends on (context of the subtree)
+    Node *key;
+    Node *value;
+};
+
+//! \brief Results of a tree function by the argument tree: hash -> entries
+struct Tree_Cache {
+    std::unordered_multimap<unsigned long long, struct Tree_Cache_Entry> entries;
+    long nodes;     // nodes of all keys and values
+    long max_nodes;
+};
+
+//! \brief Create empty cache
+//! \param [in] max_nodes Cache is cleared, when its trees have more nodes
+//! \return Returns cache
+struct Tree_Cache *
+tree_cache_create(long max_nodes) {
+    struct Tree_Cache *cache = new Tree_Cache;
+    cache->nodes = 0;
+    cache->max_nodes = max_nodes;
+    return cache;
+}
+
+//! \brief Delete all entries
+static void
+tree_cache_clear(struct Tree_Cache *cache) {
+    for (auto it = cache->entries.begin(); it != cache->entries.end(); ++it) {
+        rec_del(it->second.key);
+        rec_del(it->second.value);
+    }
+    cache->entries.clear();
+    cache->nodes = 0;
+}
+
+//! \brief Free cache with all trees in it
+void
+tree_cache_free(struct Tree_Cache *cache) {
+    if (!cache) {
+        return;
+    }
+    tree_cache_clear(cache);
+    delete cache;
+}
+
+//! \brief Find result for the tree
+//! \param [in] cache Cache
+//! \param [in] hash tree_hash of the key
+//! \param [in] tag Context of the key
+//! \param [in] key Argument tree
+//! \return Returns result, owned by the cache, or NULL
+Node *
+tree_cache_find(struct Tree_Cache *cache, unsigned long long hash, int tag, Node *key) {
+    auto range = cache->entries.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second.tag == tag && tree_same(it->second.key, key)) {
+            return it->second.value;
+        }
+    }
+    return NULL;
+}
+
+//! \brief Add result for the tree, cache owns both trees
+void
+tree_cache_put(struct Tree_Cache *cache, unsigned long long hash, int tag, Node *key, Node *value) {
+    long nodes = key->get_size() + value->get_size();
+    if (cache->nodes + nodes > cache->max_nodes) {
+        tree_cache_clear(cache);
+    }
+    cache->entries.emplace(hash, Tree_Cache_Entry{tag, key, value});
+    cache->nodes += nodes;
+}
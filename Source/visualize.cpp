@@ -1,5 +1,6 @@
 #include <cstdio>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/types.h>
@@ -9,12 +10,123 @@
 #include "tree.h"
 #include "in_and_out.h"
 #include "visualize.h"
+#include "stats.h"
+#include "cse.h"
+#include "render.h"
+#include "render_cache.h"
 
+//! \brief Make file name from base name and extension
+//! \return Returns allocated name or NULL
+static char *
+make_name(const char *filename, const char *extension) {
+    int size = strlen(filename) + strlen(extension) + 1;
+    char *name = (char *)calloc(size, sizeof(char));
+    if (!name) {
+        fprintf(stderr, "Memory allocation error\n");
+        return NULL;
+    }
+    snprintf(name, size, "%s%s", filename, extension);
+    return name;
+}
+
+//! \brief Start renderer, unless its output for the same source is in the
+//! render cache, then start viewer
+//! \param [in] argv Renderer and arguments
+//! \param [in] options Arguments, which change the output (part of cache key)
+//! \param [in] phase Phase of renderer
+//! \param [in] source Mmaped source, it is unmapped here or by the pool
+//! \param [in] size Size of source
+//! \param [in] to_stdin Write source into stdin of renderer
+//! \param [in] viewer Viewer, NULL for none
+//! \param [in] output File, written by renderer
+//! \return Returns 0 in success 1 else
+static int
+render_cached(const char *const *argv, const char *options, int phase, char *source, long size, bool to_stdin,
+              const char *const *viewer, const char *output) {
+    // output may be a link to cached file, renderer must write a new one
+    unlink(output);
+    char *entry = render_cache_entry(argv[0], options, source, size, strrchr(output, '.'));
+    int res = 0;
+    if (entry && render_cache_fetch(entry, output)) {
+        if (source) {
+            munmap(source, size);
+        }
+        if (viewer) {
+            res = render_spawn(viewer, PHASE_VIEWER) ? 1 : 0;
+        }
+    } else if (to_stdin) {
+        res = render_spawn(argv, phase, source, size, viewer, PHASE_VIEWER, output, entry) ? 1 : 0;
+    } else {
+        if (source) {
+            munmap(source, size);
+        }
+        res = render_spawn(argv, phase, NULL, 0, viewer, PHASE_VIEWER, output, entry) ? 1 : 0;
+    }
+    free(entry);
+    return res;
+}
+
+//! \brief Make pdftex option, which puts its outputs next to the document:
+//! pdftex writes them into the current directory else
+//! \return Returns allocated option or NULL
+static char *
+output_dir_option(const char *filename) {
+    const char *slash = strrchr(filename, '/');
+    const char *dir = slash ? filename : ".";
+    int dir_size = (slash && slash != filename) ? slash - filename : 1;
+    int size = sizeof("-output-directory=") + dir_size;
+    char *option = (char *)calloc(size, sizeof(char));
+    if (!option) {
+        fprintf(stderr, "Memory allocation error\n");
+        return NULL;
+    }
+    snprintf(option, size, "-output-directory=%.*s", dir_size, dir);
+    return option;
+}
+
+//! \brief Start pdftex for the document and viewer after it
+//! \param [in] filename Base name of .tex and .pdf
+//! \param [in] show Open pdf in viewer
+//! \return Returns 0 in success 1 else
+static int
+render_pdf(const char *filename, int show) {
+    char *tex_name = make_name(filename, ".tex");
+    char *pdf_name = make_name(filename, ".pdf");
+    char *out_dir = output_dir_option(filename);
+    int res = 1;
+    if (tex_name && pdf_name && out_dir) {
+        const char *pdftex[] = {"pdftex", out_dir, tex_name, NULL};
+        const char *viewer[] = {"gio", "open", pdf_name, NULL};
+        long size = 0;
+        char *source = render_cache_used() ? mmap_file(tex_name, &size, true) : NULL;
+        res = render_cached(pdftex, "", PHASE_PDFTEX, source, size, false, show ? viewer : NULL, pdf_name);
+    }
+    free(tex_name);
+    free(pdf_name);
+    free(out_dir);
+    return res;
+}
+
+//! \brief Export tree in dot format, render png and open it
+//! \param [in] filename Base name of output files
+//! \param [in] root Tree
+//! \param [in] show Open png in viewer
+//! \param [in] shared Draw equal subtrees once (see cse.cpp)
+//! \param [in] lod Level of detail and subtree to draw (see Dot_Lod), NULL to draw all
+//! \return Returns 0 in success 1 else
 int
-create_png(char *filename, Node *root, bool show) {
+create_png(char *filename, Node *root, bool show, bool shared, const struct Dot_Lod *lod) {
     if (!root) {
         return 1;
     }
+    if (lod && lod->path) {
+        root->expand_lazy();
+        root = root->find_path(lod->path);
+        if (!root) {
+            fprintf(stderr, "No subtree %s in %s\n", lod->path, filename);
+            return 1;
+        }
+    }
 
     int base_file_name = strlen(filename);
 
@@ -32,25 +144,32 @@ create_png(char *filename, Node *root, bool show) {
         return 1;
     }
 
-    root->export_dot(out);
+    long long start = stats_begin(PHASE_EXPORT_DOT);
+    if (shared) {
+        struct Cse_Dag *dag = cse_build(root);
+        cse_export_dot(dag, out);
+        cse_free(dag);
+    } else {
+        root->export_dot(out, NULL, lod);
+    }
+    stats_add_time(PHASE_EXPORT_DOT, start);
+    STAT_ADD(BYTES_WRITTEN, lseek(out, 0, SEEK_CUR));
     close(out);
 
-    char *commands_buffer = (char *)calloc(BUFFER_SIZE, sizeof(char));
-    if (!commands_buffer) {
-        fprintf(stderr, "Memory allocation error\n");
+    char *png_name = make_name(filename, ".png");
+    if (!png_name) {
+        free(file_out);
         return 1;
     }
-
-//create png
-    snprintf(commands_buffer, BUFFER_SIZE, "dot -Tpng -o%s.png %s.dot", filename, filename);
-    system(commands_buffer);
-//open png
-    if (show) {
-        snprintf(commands_buffer, BUFFER_SIZE, "eog %s.png", filename);
-        system(commands_buffer);
-    }
-    free(commands_buffer);
-    return 0;
+//create png: dot reads the source from pipe, while the program goes on, then png is opened
+    long size = 0;
+    char *source = mmap_file(file_out, &size, true);
+    const char *dot[] = {"dot", "-Tpng", "-o", png_name, source ? NULL : file_out, NULL};
+    const char *viewer[] = {"eog", png_name, NULL};
+    int res = render_cached(dot, "-Tpng", PHASE_DOT, source, size, true, show ? viewer : NULL, png_name);
+    free(png_name);
+    free(file_out);
+    return res;
 }
 
 int
@@ -75,23 +194,140 @@ create_pdf(char *filename, Node *root, int show) {
         return 1;
     }
     
+    long long start = stats_begin(PHASE_EXPORT_TEX);
     root->export_tex(fd);
+    stats_add_time(PHASE_EXPORT_TEX, start);
+    STAT_ADD(BYTES_WRITTEN, lseek(fd, 0, SEEK_CUR));
     close(fd);
+    free(file_out);
+    return render_pdf(filename, show);
+}
 
-    char *commands_buffer = (char *)calloc(BUFFER_SIZE, sizeof(char));
-    if (!commands_buffer) {
-        fprintf(stderr, "Memory allocation error\n");
-        return 1;
+//! \brief One TeX document for all formulas of a run: pdftex is started once
+//! for it instead of once for every tree
+struct Tex_Doc {
+    char *name;         // base name of .tex and .pdf
+    char *tmp_name;     // document is written here and renamed, when it is complete
+    int fd;
+    int sections;
+    int formulas;
+};
+
+//! \brief Write text, escaping symbols, which are special for TeX
+//! \param [in] fd File descriptor
+//! \param [in] text Text
+static void
+tex_escape(int fd, const char *text) {
+    for (; *text; text++) {
+        if (strchr("#$%&_{}", *text)) {
+            dprintf(fd, "\\%c", *text);
+        } else if (strchr("\\^~", *text)) {
+            dprintf(fd, "{\\tt\\char%d}", *text);
+        } else {
+            dprintf(fd, "%c", *text);
+        }
     }
+}
 
-    snprintf(commands_buffer, BUFFER_SIZE, "pdftex %s.tex > pdftex_out; rm pdftex_out", filename);
-    system(commands_buffer);
+//! \brief Start TeX document
+//! \param [in] name Base name of .tex and .pdf files
+//! \return Returns document or NULL
+struct Tex_Doc *
+tex_doc_open(const char *name) {
+    struct Tex_Doc *doc = (struct Tex_Doc *)calloc(1, sizeof(*doc));
+    int name_len = strlen(name);
+    if (doc) {
+        doc->name = strdup(name);
+        doc->tmp_name = (char *)calloc(name_len + sizeof(".tex.tmp"), sizeof(char));
+    }
+    if (!doc || !doc->name || !doc->tmp_name) {
+        fprintf(stderr, "Memory allocation error\n");
+        if (doc) {
+            free(doc->name);
+            free(doc->tmp_name);
+        }
+        free(doc);
+        return NULL;
+    }
+    snprintf(doc->tmp_name, name_len + sizeof(".tex.tmp"), "%s.tex.tmp", name);
+    doc->fd = open(doc->tmp_name, O_WRONLY | O_CREAT | O_TRUNC, out_mode);
+    if (doc->fd < 0) {
+        fprintf(stderr, "Can not open file %s\n", doc->tmp_name);
+        free(doc->name);
+        free(doc->tmp_name);
+        free(doc);
+        return NULL;
+    }
+    return doc;
+}
 
-    if (show) {
-        snprintf(commands_buffer, BUFFER_SIZE, "gio open %s.pdf", filename);
-        system(commands_buffer);
+//! \brief Start section (new page) of the document
+//! \param [in] doc Document
+//! \param [in] title Title of the section
+//! \return Returns 0 in success 1 else
+int
+tex_doc_section(struct Tex_Doc *doc, const char *title) {
+    if (!doc || !title) {
+        return 1;
     }
+    if (doc->sections) {
+        dprintf(doc->fd, "\\vfill\\eject\n");
+    }
+    dprintf(doc->fd, "\\beginsection ");
+    tex_escape(doc->fd, title);
+    dprintf(doc->fd, "\\par\n");
+    doc->sections++;
     return 0;
+}
 
+//! \brief Add formula to the current section
+//! \param [in] doc Document
+//! \param [in] caption Text before formula
+//! \param [in] root Tree
+//! \return Returns 0 in success 1 else
+int
+tex_doc_add(struct Tex_Doc *doc, const char *caption, Node *root) {
+    if (!doc || !root) {
+        return 1;
+    }
+    long long start = stats_begin(PHASE_EXPORT_TEX);
+    if (caption) {
+        tex_escape(doc->fd, caption);
+        dprintf(doc->fd, "\n");
+    }
+    root->export_tex(doc->fd, false);
+    stats_add_time(PHASE_EXPORT_TEX, start);
+    doc->formulas++;
+    return 0;
 }
 
+//! \brief Finish document, render it by one pdftex run and open it
+//! \param [in] doc Document, is freed
+//! \param [in] show Open pdf in viewer
+//! \return Returns 0 in success 1 else
+int
+tex_doc_close(struct Tex_Doc *doc, int show) {
+    if (!doc) {
+        return 1;
+    }
+    dprintf(doc->fd, "\\bye\n");
+    STAT_ADD(BYTES_WRITTEN, lseek(doc->fd, 0, SEEK_CUR));
+    close(doc->fd);
+    int res = 0;
+    char *file_out = make_name(doc->name, ".tex");
+    if (!file_out) {
+        res = 1;
+    } else if (!doc->formulas) { // nothing was exported, previous document is kept
+        unlink(doc->tmp_name);
+    } else if (rename(doc->tmp_name, file_out)) {
+        fprintf(stderr, "Can not write file %s\n", file_out);
+        res = 1;
+    } else {
+        res = render_pdf(doc->name, show);
+    }
+    free(file_out);
+    free(doc->name);
+    free(doc->tmp_name);
+    free(doc);
+    return res;
+}
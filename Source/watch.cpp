@@ -0,0 +1,73 @@
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#include "watch.h"
+#include "stats.h"
+
+//! \brief Read pending inotify events
+//! \param [in] fd inotify descriptor
+//! \param [in] name Name of the watched file in its directory
+//! \return Returns true, if some event is about the file, -1 on error
+static int
+read_events(int fd, const char *name) {
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len = read(fd, buffer, sizeof(buffer));
+    if (len <= 0) {
+        return -1;
+    }
+    int res = 0;
+    for (char *ptr = buffer; ptr < buffer + len; ) {
+        struct inotify_event *event = (struct inotify_event *)ptr;
+        if (event->len && !strcmp(event->name, name)) {
+            res = 1;
+        }
+        ptr += sizeof(struct inotify_event) + event->len;
+    }
+    return res;
+}
+
+//! \brief Call on_change now and every time the file is saved. The directory is
+//! watched, as editors often write a new file and rename it over the old one.
+//! Events, which come within WATCH_DEBOUNCE_MS, are handled as one change.
+//! \param [in] filename Watched file
+//! \param [in] on_change Callback, its result is printed only
+//! \param [in] arg Argument of the callback
+//! \return Returns -1 on error (never returns otherwise)
+int
+watch_file(const char *filename, int (*on_change)(void *arg), void *arg) {
+    const char *slash = strrchr(filename, '/');
+    const char *name = slash ? slash + 1 : filename;
+    char *dir = slash ? strndup(filename, slash - filename + 1) : strdup(".");
+    int fd = inotify_init1(IN_CLOEXEC);
+    if (fd < 0 || inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+        fprintf(stderr, "Can not watch directory %s\n", dir);
+        free(dir);
+        return -1;
+    }
+    free(dir);
+    while (true) {
+        long long start = stats_now();
+        int res = on_change(arg);
+        fprintf(stderr, "%s: %s in %.1f ms, waiting for changes\n", filename,
+                res ? "failed" : "processed", (stats_now() - start) / 1e6);
+        int changed = 0;
+        while (changed <= 0) {
+            changed = read_events(fd, name);
+            if (changed < 0) {
+                fprintf(stderr, "Can not read inotify events\n");
+                close(fd);
+                return -1;
+            }
+        }
+        struct pollfd pfd = {fd, POLLIN, 0};
+        while (poll(&pfd, 1, WATCH_DEBOUNCE_MS) > 0) {
+            if (read_events(fd, name) < 0) {
+                break;
+            }
+        }
+    }
+}